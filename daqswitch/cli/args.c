@@ -49,18 +49,37 @@
 
 #include "../common/common.h"
 #include "../daqswitch/daqswitch.h"
+#include "../daqswitch/daqswitch_mempool.h"
+#include "../stats/ipfix.h"
+#include "../trace/trace.h"
 #include "cli.h"
 
 #define CMD_LINE_OPT_CONFIG "config"
 #define CMD_LINE_OPT_NO_CLI "disable-cli"
+#define CMD_LINE_OPT_IPFIX_COLLECTOR "ipfix-collector"
+#define CMD_LINE_OPT_IPFIX_FILE "ipfix-file"
+#define CMD_LINE_OPT_IPFIX_INTERVAL "ipfix-interval"
+#define CMD_LINE_OPT_TRACE_FILE "trace-file"
+#define CMD_LINE_OPT_MBUFS "mbufs"
+#define CMD_LINE_OPT_MBUF_OVERCOMMIT "mbuf-overcommit"
+#define CMD_LINE_OPT_MTU "mtu"
 
 /* display usage */
 static void
 print_usage(const char *prgname)
 {
 	printf ("%s [EAL options] -- \n"
-        "  [--disable-cli]: disable cli interface\n",
-		prgname);
+        "  [--disable-cli]: disable cli interface\n"
+        "  [--ipfix-collector IP:PORT]: export flow records over udp\n"
+        "  [--ipfix-file PATH]: export flow records to a file\n"
+        "  [--ipfix-interval S]: flow record export interval (default %u s)\n"
+        "  [--trace-file PATH]: trace dump file (default %s)\n"
+        "  [--mbufs PORT:N]: mbufs reserved for a port (default %u)\n"
+        "  [--mbuf-overcommit PCT]: reservations over the size of a socket mempool (default %u%%)\n"
+        "  [--mtu N]: mtu of all ports, up to %u (default %u)\n",
+		prgname, IPFIX_INTERVAL_DEFAULT, TRACE_FILE_DEFAULT,
+		DAQSWITCH_MBUFS_PER_PORT, DAQSWITCH_MBUF_OVERCOMMIT,
+		DAQSWITCH_MTU_MAX, DAQSWITCH_MTU_DEFAULT);
 }
 
 /* Parse the argument given in the command line of the application */
@@ -73,6 +92,13 @@ int parse_args(int argc, char **argv)
 	char *prgname = argv[0];
 	static struct option lgopts[] = {
 		{CMD_LINE_OPT_NO_CLI, 0, 0, 0},
+		{CMD_LINE_OPT_IPFIX_COLLECTOR, 1, 0, 0},
+		{CMD_LINE_OPT_IPFIX_FILE, 1, 0, 0},
+		{CMD_LINE_OPT_IPFIX_INTERVAL, 1, 0, 0},
+		{CMD_LINE_OPT_TRACE_FILE, 1, 0, 0},
+		{CMD_LINE_OPT_MBUFS, 1, 0, 0},
+		{CMD_LINE_OPT_MBUF_OVERCOMMIT, 1, 0, 0},
+		{CMD_LINE_OPT_MTU, 1, 0, 0},
 		{NULL, 0, 0, 0}
 	};
 
@@ -89,6 +115,75 @@ int parse_args(int argc, char **argv)
                 daqswitch_get_config()->cli_enabled = false;
 			}
 
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_IPFIX_COLLECTOR,
+				sizeof (CMD_LINE_OPT_IPFIX_COLLECTOR))) {
+                if (ipfix_set_collector(optarg) < 0) {
+                    printf("invalid ipfix collector %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_IPFIX_FILE,
+				sizeof (CMD_LINE_OPT_IPFIX_FILE))) {
+                if (ipfix_set_file(optarg) < 0) {
+                    printf("cannot open ipfix file %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_IPFIX_INTERVAL,
+				sizeof (CMD_LINE_OPT_IPFIX_INTERVAL))) {
+                if (ipfix_set_interval(optarg) < 0) {
+                    printf("invalid ipfix interval %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_TRACE_FILE,
+				sizeof (CMD_LINE_OPT_TRACE_FILE))) {
+                if (trace_set_file(optarg) < 0) {
+                    printf("invalid trace file %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_MBUFS,
+				sizeof (CMD_LINE_OPT_MBUFS))) {
+                if (daqswitch_mempool_set_reservation(optarg) < 0) {
+                    printf("invalid mbuf reservation %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_MBUF_OVERCOMMIT,
+				sizeof (CMD_LINE_OPT_MBUF_OVERCOMMIT))) {
+                if (daqswitch_mempool_set_overcommit(optarg) < 0) {
+                    printf("invalid mbuf overcommit %s, at least 100%%\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+			}
+
+			if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_MTU,
+				sizeof (CMD_LINE_OPT_MTU))) {
+                unsigned long mtu;
+                char *end;
+
+                mtu = strtoul(optarg, &end, 10);
+                if (end == optarg || *end != '\0' ||
+                    mtu < DAQSWITCH_MTU_MIN || mtu > DAQSWITCH_MTU_MAX) {
+                    printf("invalid mtu %s\n", optarg);
+                    print_usage(prgname);
+                    return -1;
+                }
+                daqswitch_get_config()->mtu = mtu;
+			}
+
             break;
 
 		default:
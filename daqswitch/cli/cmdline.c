@@ -11,6 +11,7 @@
  */
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <termios.h>
 
 #include <rte_ethdev.h>
@@ -23,8 +24,10 @@
 
 #include "../common/common.h"
 #include "../stats/stats.h"
+#include "../trace/trace.h"
 #include "../dp/include/dp.h"
 #include "../daqswitch/daqswitch_port.h"
+#include "../daqswitch/daqswitch_mempool.h"
 #include "cli.h"
 
 struct cmd_all_result {
@@ -67,6 +70,100 @@ struct cmd_fdir_result {
 cmdline_parse_token_string_t cmd_fdir_string = 
     TOKEN_STRING_INITIALIZER(struct cmd_fdir_result, fdir, "fdir");
 
+struct cmd_latency_result {
+    cmdline_fixed_string_t latency;
+};
+cmdline_parse_token_string_t cmd_latency_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_latency_result, latency, "latency");
+
+struct cmd_mempool_result {
+    cmdline_fixed_string_t mempool;
+};
+cmdline_parse_token_string_t cmd_mempool_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_mempool_result, mempool, "mempool");
+
+struct cmd_admission_result {
+    cmdline_fixed_string_t admission;
+};
+cmdline_parse_token_string_t cmd_admission_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_admission_result, admission, "admission");
+
+struct cmd_tcp_result {
+    cmdline_fixed_string_t tcp;
+};
+cmdline_parse_token_string_t cmd_tcp_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tcp_result, tcp, "tcp");
+struct cmd_trace_result {
+    cmdline_fixed_string_t trace;
+    cmdline_fixed_string_t show;
+    uint32_t count;
+};
+cmdline_parse_token_string_t cmd_trace_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_trace_result, trace, "trace");
+cmdline_parse_token_string_t cmd_trace_show_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_trace_result, show, "show");
+cmdline_parse_token_num_t cmd_trace_count = 
+    TOKEN_NUM_INITIALIZER(struct cmd_trace_result, count, UINT32);
+struct cmd_set_result {
+    cmdline_fixed_string_t set;
+    cmdline_fixed_string_t name;
+    uint32_t value;
+};
+cmdline_parse_token_string_t cmd_set_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_set_result, set, "set");
+/* any name, dp_param_set rejects those the datapath does not know */
+cmdline_parse_token_string_t cmd_set_name = 
+    TOKEN_STRING_INITIALIZER(struct cmd_set_result, name, NULL);
+cmdline_parse_token_num_t cmd_set_value = 
+    TOKEN_NUM_INITIALIZER(struct cmd_set_result, value, UINT32);
+struct cmd_params_result {
+    cmdline_fixed_string_t params;
+};
+cmdline_parse_token_string_t cmd_params_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_params_result, params, "params");
+struct cmd_lcores_result {
+    cmdline_fixed_string_t lcores;
+    cmdline_fixed_string_t action;
+};
+cmdline_parse_token_string_t cmd_lcores_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_lcores_result, lcores, "lcores");
+cmdline_parse_token_string_t cmd_lcores_action = 
+    TOKEN_STRING_INITIALIZER(struct cmd_lcores_result, action, "show#balance");
+struct cmd_tc_result {
+    cmdline_fixed_string_t tc;
+    cmdline_fixed_string_t action;
+};
+cmdline_parse_token_string_t cmd_tc_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tc_result, tc, "tc");
+cmdline_parse_token_string_t cmd_tc_show_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tc_result, action, "show");
+struct cmd_tc_rule_result {
+    cmdline_fixed_string_t tc;
+    cmdline_fixed_string_t rule;
+    cmdline_fixed_string_t kind;
+    uint8_t dscp_min;
+    uint8_t dscp_max;
+    uint16_t port_min;
+    uint16_t port_max;
+    uint8_t class;
+};
+cmdline_parse_token_string_t cmd_tc_rule_tc_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tc_rule_result, tc, "tc");
+cmdline_parse_token_string_t cmd_tc_rule_string = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tc_rule_result, rule, "rule");
+cmdline_parse_token_string_t cmd_tc_rule_kind = 
+    TOKEN_STRING_INITIALIZER(struct cmd_tc_rule_result, kind, "any#req#data");
+cmdline_parse_token_num_t cmd_tc_rule_dscp_min = 
+    TOKEN_NUM_INITIALIZER(struct cmd_tc_rule_result, dscp_min, UINT8);
+cmdline_parse_token_num_t cmd_tc_rule_dscp_max = 
+    TOKEN_NUM_INITIALIZER(struct cmd_tc_rule_result, dscp_max, UINT8);
+cmdline_parse_token_num_t cmd_tc_rule_port_min = 
+    TOKEN_NUM_INITIALIZER(struct cmd_tc_rule_result, port_min, UINT16);
+cmdline_parse_token_num_t cmd_tc_rule_port_max = 
+    TOKEN_NUM_INITIALIZER(struct cmd_tc_rule_result, port_max, UINT16);
+cmdline_parse_token_num_t cmd_tc_rule_class = 
+    TOKEN_NUM_INITIALIZER(struct cmd_tc_rule_result, class, UINT8);
+
 
 /* reset stats */
 static void
@@ -115,6 +212,315 @@ cmdline_parse_inst_t cmd_stats_show_all = {
     },
 };
 
+/* print sojourn time percentiles */
+static void
+cmd_stats_latency_parsed(__attribute__((unused)) void *parsed_result,
+                         __attribute__((unused)) struct cmdline *cl,
+                         __attribute__((unused)) void *data) {
+
+    dp_dump_latency();
+
+}
+
+cmdline_parse_inst_t cmd_stats_latency = {
+    .f = cmd_stats_latency_parsed,
+    .data = NULL,
+    .help_str = "show sojourn time percentiles",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_latency_string,
+        NULL,
+    },
+};
+
+/* print mempool occupancy */
+static void
+cmd_stats_mempool_parsed(__attribute__((unused)) void *parsed_result,
+                         __attribute__((unused)) struct cmdline *cl,
+                         __attribute__((unused)) void *data) {
+
+    daqswitch_mempool_dump();
+
+}
+
+cmdline_parse_inst_t cmd_stats_mempool = {
+    .f = cmd_stats_mempool_parsed,
+    .data = NULL,
+    .help_str = "show mempool occupancy",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_mempool_string,
+        NULL,
+    },
+};
+
+/* print request admission state per dcm */
+static void
+cmd_stats_admission_parsed(__attribute__((unused)) void *parsed_result,
+                           __attribute__((unused)) struct cmdline *cl,
+                           __attribute__((unused)) void *data) {
+
+    dp_dump_admission();
+
+}
+
+cmdline_parse_inst_t cmd_stats_admission = {
+    .f = cmd_stats_admission_parsed,
+    .data = NULL,
+    .help_str = "show outstanding response bytes and held requests per dcm",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_admission_string,
+        NULL,
+    },
+};
+
+/* reset sojourn time histograms */
+static void
+cmd_stats_latency_reset_parsed(__attribute__((unused)) void *parsed_result,
+                               __attribute__((unused)) struct cmdline *cl,
+                               __attribute__((unused)) void *data) {
+
+    dp_reset_latency();
+
+}
+
+cmdline_parse_inst_t cmd_stats_latency_reset = {
+    .f = cmd_stats_latency_reset_parsed,
+    .data = NULL,
+    .help_str = "reset sojourn time histograms",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_latency_string,
+        (void *)&cmd_reset_string,
+        NULL,
+    },
+};
+
+/* print tcp health of the data flows */
+static void
+cmd_stats_tcp_parsed(__attribute__((unused)) void *parsed_result,
+                     __attribute__((unused)) struct cmdline *cl,
+                     __attribute__((unused)) void *data) {
+
+    dp_dump_tcp();
+
+}
+
+cmdline_parse_inst_t cmd_stats_tcp = {
+    .f = cmd_stats_tcp_parsed,
+    .data = NULL,
+    .help_str = "show tcp retransmissions, gaps and duplicate acks",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_tcp_string,
+        NULL,
+    },
+};
+
+/* reset tcp monitor counters */
+static void
+cmd_stats_tcp_reset_parsed(__attribute__((unused)) void *parsed_result,
+                           __attribute__((unused)) struct cmdline *cl,
+                           __attribute__((unused)) void *data) {
+
+    dp_reset_tcp();
+
+}
+
+cmdline_parse_inst_t cmd_stats_tcp_reset = {
+    .f = cmd_stats_tcp_reset_parsed,
+    .data = NULL,
+    .help_str = "reset tcp monitor counters",
+    .tokens = {
+        (void *)&cmd_stats_string,
+        (void *)&cmd_tcp_string,
+        (void *)&cmd_reset_string,
+        NULL,
+    },
+};
+
+/* print the most recent trace events */
+static void
+cmd_trace_show_parsed(void *parsed_result,
+                      __attribute__((unused)) struct cmdline *cl,
+                      __attribute__((unused)) void *data) {
+
+    struct cmd_trace_result *params = parsed_result;
+
+    trace_show(params->count ? params->count : TRACE_SHOW_COUNT);
+}
+
+cmdline_parse_inst_t cmd_trace_show = {
+    .f = cmd_trace_show_parsed,
+    .data = NULL,
+    .help_str = "show the most recent trace events",
+    .tokens = {
+        (void *)&cmd_trace_string,
+        (void *)&cmd_trace_show_string,
+        (void *)&cmd_trace_count,
+        NULL,
+    },
+};
+
+/* print the TRACE_SHOW_COUNT most recent trace events */
+static void
+cmd_trace_show_default_parsed(__attribute__((unused)) void *parsed_result,
+                              __attribute__((unused)) struct cmdline *cl,
+                              __attribute__((unused)) void *data) {
+
+    trace_show(TRACE_SHOW_COUNT);
+}
+
+cmdline_parse_inst_t cmd_trace_show_default = {
+    .f = cmd_trace_show_default_parsed,
+    .data = NULL,
+    .help_str = "show the most recent trace events",
+    .tokens = {
+        (void *)&cmd_trace_string,
+        (void *)&cmd_trace_show_string,
+        NULL,
+    },
+};
+
+/* write the trace rings to the trace file */
+static void
+cmd_trace_dump_parsed(__attribute__((unused)) void *parsed_result,
+                      __attribute__((unused)) struct cmdline *cl,
+                      __attribute__((unused)) void *data) {
+
+    trace_dump();
+
+}
+
+cmdline_parse_inst_t cmd_trace_dump = {
+    .f = cmd_trace_dump_parsed,
+    .data = NULL,
+    .help_str = "dump the trace rings to a file",
+    .tokens = {
+        (void *)&cmd_trace_string,
+        (void *)&cmd_dump_string,
+        NULL,
+    },
+};
+
+/* change a datapath parameter at runtime */
+static void
+cmd_set_parsed(void *parsed_result,
+               __attribute__((unused)) struct cmdline *cl,
+               __attribute__((unused)) void *data) {
+
+    struct cmd_set_result *params = parsed_result;
+
+    dp_param_set(params->name, params->value);
+
+}
+
+cmdline_parse_inst_t cmd_set = {
+    .f = cmd_set_parsed,
+    .data = NULL,
+    .help_str = "set a datapath parameter, see show params",
+    .tokens = {
+        (void *)&cmd_set_string,
+        (void *)&cmd_set_name,
+        (void *)&cmd_set_value,
+        NULL,
+    },
+};
+
+/* print the datapath parameters */
+static void
+cmd_show_params_parsed(__attribute__((unused)) void *parsed_result,
+                       __attribute__((unused)) struct cmdline *cl,
+                       __attribute__((unused)) void *data) {
+
+    dp_dump_params();
+
+}
+
+cmdline_parse_inst_t cmd_show_params = {
+    .f = cmd_show_params_parsed,
+    .data = NULL,
+    .help_str = "show the datapath parameters",
+    .tokens = {
+        (void *)&cmd_show_string,
+        (void *)&cmd_params_string,
+        NULL,
+    },
+};
+
+/* lcore load and ports, or a balancing run */
+static void
+cmd_lcores_parsed(void *parsed_result,
+                  __attribute__((unused)) struct cmdline *cl,
+                  __attribute__((unused)) void *data) {
+    struct cmd_lcores_result *params = parsed_result;
+
+    if (strcmp(params->action, "balance") == 0) {
+        dp_balance_lcores();
+    }
+    dp_dump_lcores();
+
+}
+
+cmdline_parse_inst_t cmd_lcores = {
+    .f = cmd_lcores_parsed,
+    .data = NULL,
+    .help_str = "lcores show|balance: show the load of the data lcores, or move a port off the busiest one",
+    .tokens = {
+        (void *)&cmd_lcores_string,
+        (void *)&cmd_lcores_action,
+        NULL,
+    },
+};
+
+/* traffic classes */
+static void
+cmd_tc_show_parsed(__attribute__((unused)) void *parsed_result,
+                   __attribute__((unused)) struct cmdline *cl,
+                   __attribute__((unused)) void *data) {
+    dp_dump_tc();
+}
+
+cmdline_parse_inst_t cmd_tc_show = {
+    .f = cmd_tc_show_parsed,
+    .data = NULL,
+    .help_str = "tc show: show the traffic classes, their weights, packets and rules",
+    .tokens = {
+        (void *)&cmd_tc_string,
+        (void *)&cmd_tc_show_string,
+        NULL,
+    },
+};
+
+static void
+cmd_tc_rule_parsed(void *parsed_result,
+                   __attribute__((unused)) struct cmdline *cl,
+                   __attribute__((unused)) void *data) {
+    struct cmd_tc_rule_result *params = parsed_result;
+
+    dp_add_tc_rule(params->kind, params->dscp_min, params->dscp_max,
+                   params->port_min, params->port_max, params->class);
+}
+
+cmdline_parse_inst_t cmd_tc_rule = {
+    .f = cmd_tc_rule_parsed,
+    .data = NULL,
+    .help_str = "tc rule any|req|data DSCP_MIN DSCP_MAX ROS_PORT_MIN ROS_PORT_MAX CLASS: "
+                "classify new voqs",
+    .tokens = {
+        (void *)&cmd_tc_rule_tc_string,
+        (void *)&cmd_tc_rule_string,
+        (void *)&cmd_tc_rule_kind,
+        (void *)&cmd_tc_rule_dscp_min,
+        (void *)&cmd_tc_rule_dscp_max,
+        (void *)&cmd_tc_rule_port_min,
+        (void *)&cmd_tc_rule_port_max,
+        (void *)&cmd_tc_rule_class,
+        NULL,
+    },
+};
+
 /* dump cfg */
 static void
 cmd_dump_parsed(__attribute__((unused)) void *parsed_result,
@@ -194,8 +600,22 @@ cmdline_parse_inst_t cmd_quit = {
 cmdline_parse_ctx_t cmdline_ctx[] = {
     (cmdline_parse_inst_t *)&cmd_stats_show_all,
     (cmdline_parse_inst_t *)&cmd_stats_reset,
+    (cmdline_parse_inst_t *)&cmd_stats_latency,
+    (cmdline_parse_inst_t *)&cmd_stats_latency_reset,
+    (cmdline_parse_inst_t *)&cmd_stats_mempool,
+    (cmdline_parse_inst_t *)&cmd_stats_admission,
+    (cmdline_parse_inst_t *)&cmd_stats_tcp,
+    (cmdline_parse_inst_t *)&cmd_stats_tcp_reset,
     (cmdline_parse_inst_t *)&cmd_dump,
     (cmdline_parse_inst_t *)&cmd_dump_fdir,
+    (cmdline_parse_inst_t *)&cmd_trace_show,
+    (cmdline_parse_inst_t *)&cmd_trace_show_default,
+    (cmdline_parse_inst_t *)&cmd_trace_dump,
+    (cmdline_parse_inst_t *)&cmd_set,
+    (cmdline_parse_inst_t *)&cmd_show_params,
+    (cmdline_parse_inst_t *)&cmd_lcores,
+    (cmdline_parse_inst_t *)&cmd_tc_show,
+    (cmdline_parse_inst_t *)&cmd_tc_rule,
     (cmdline_parse_inst_t *)&cmd_quit,
     NULL
 };
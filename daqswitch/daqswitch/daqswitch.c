@@ -15,8 +15,10 @@
 #include "daqswitch.h"
 #include "daqswitch_flow.h"
 #include "daqswitch_port.h"
+#include "daqswitch_mempool.h"
 #include "../dp/include/dp.h"
 #include "../common/common.h"
+#include "../trace/trace.h"
 
 static struct daqswitch daqswitch = {
     .configured = false,
@@ -25,6 +27,8 @@ static struct daqswitch daqswitch = {
 
     .cli_enabled = true,
 
+    .mtu = DAQSWITCH_MTU_DEFAULT,
+
 };
 
 /* Check the link status of all ports in up to 9s, and print them finally */
@@ -110,6 +114,10 @@ daqswitch_init(void)
 
 	daqswitch.nb_lcores = rte_lcore_count();
 
+    /* flight recorder first, so it covers the bring-up */
+    ret = trace_init();
+    DAQSWITCH_LOG_AND_RETURN_ON_ERR("Cannot initialize tracing");
+
     /* initialize ports */
     DAQSWITCH_PORT_FOREACH(portid) {
         ret = daqswitch_port_init(portid);
@@ -169,6 +177,10 @@ daqswitch_configure(void)
     ret = dp_configure();
     DAQSWITCH_LOG_AND_RETURN_ON_ERR("Cannot configure datapath");
 
+    /* mbuf pools, sized from the final port configuration */
+    ret = daqswitch_mempool_create();
+    DAQSWITCH_LOG_AND_RETURN_ON_ERR("Cannot create mempools");
+
     /* configure ports */
     DAQSWITCH_PORT_FOREACH(portid) {
         ret = daqswitch_port_configure(portid);
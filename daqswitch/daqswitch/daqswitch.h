@@ -16,6 +16,7 @@
 #include <stdbool.h>
 
 #include <rte_ethdev.h>
+#include <rte_ether.h>
 #include <rte_lcore.h>
 #include <rte_mempool.h>
 #include <rte_ring.h>
@@ -28,18 +29,23 @@
 #else
     #define DAQSWITCH_NUMA_ON                                                                    1
 #endif
+/* default mbuf reservation of a port, see daqswitch_mempool.h */
 #define DAQSWITCH_MBUFS_PER_PORT                                                            524287               
 #define DAQSWITCH_MBUF_CACHE_SIZE                                                              256
 #define DAQSWITCH_MBUF_RX_DATA_SIZE                                                           2048
 #define DAQSWITCH_MBUF_OVERHEAD                   (sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
 #define DAQSWITCH_MBUF_SIZE                (DAQSWITCH_MBUF_RX_DATA_SIZE + DAQSWITCH_MBUF_OVERHEAD)
+/* frames longer than the mbuf data room are received into mbuf chains */
+#define DAQSWITCH_MTU_MIN                                                                       68
+#define DAQSWITCH_MTU_DEFAULT                                                                 1500
+#define DAQSWITCH_MTU_MAX                                                                     9000
 
 #define DAQSWITCH_MAX_PORTS                                                       RTE_MAX_ETHPORTS
 #define DAQSWITCH_MAX_LCORES                                                         RTE_MAX_LCORE
 #define DAQSWITCH_MAX_SOCKETS                                                                    2
 #define DAQSWITCH_MAX_QUEUES_PER_PORT                                                            64
 
-#define get_socket_id(lcore_id) DAQSWITCH_NUMA_ON ? rte_lcore_to_socket_id(lcore_id) : 0
+#define get_socket_id(lcore_id) (DAQSWITCH_NUMA_ON ? rte_lcore_to_socket_id(lcore_id) : 0)
 
 struct daqswitch {
     bool configured;
@@ -52,6 +58,8 @@ struct daqswitch {
 
     uint8_t nb_ports;
 
+    uint16_t mtu;
+
     uint32_t enabled_core_mask;
 
     int (*dp_thread)(void *);
@@ -81,6 +89,26 @@ daqswitch_set_enabled_core_mask(uint32_t core_mask)
     daqswitch_get_config()->enabled_core_mask = core_mask;
 }
 
+static inline uint16_t
+daqswitch_get_mtu(void)
+{
+    return daqswitch_get_config()->mtu;
+}
+
+/* largest frame on the wire, crc included */
+static inline uint32_t
+daqswitch_get_max_frame_len(void)
+{
+    return daqswitch_get_mtu() + ETHER_HDR_LEN + ETHER_CRC_LEN;
+}
+
+/* mbufs taken by the largest frame */
+static inline unsigned
+daqswitch_get_max_frame_segs(void)
+{
+    return (daqswitch_get_max_frame_len() + DAQSWITCH_MBUF_RX_DATA_SIZE - 1) / DAQSWITCH_MBUF_RX_DATA_SIZE;
+}
+
 static inline uint8_t
 daqswitch_get_nb_ports(void)
 {
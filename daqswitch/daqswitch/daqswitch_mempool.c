@@ -0,0 +1,260 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_alarm.h>
+#include <rte_errno.h>
+
+#include "../common/common.h"
+
+#include "daqswitch.h"
+#include "daqswitch_port.h"
+#include "daqswitch_mempool.h"
+
+struct daqswitch_mempool {
+    struct rte_mempool *mp;
+    uint32_t size;
+    uint32_t reserved;
+    unsigned cache_size;
+    uint8_t nb_ports;
+
+    /* written by the monitor only */
+    uint32_t min_free;
+    bool low;
+};
+
+static struct daqswitch_mempool pools[RTE_MAX_NUMA_NODES];
+
+/* 0 for the default */
+static uint32_t reservations[RTE_MAX_ETHPORTS];
+static uint32_t overcommit = DAQSWITCH_MBUF_OVERCOMMIT;
+
+/* PORT:N */
+int
+daqswitch_mempool_set_reservation(const char *arg)
+{
+    unsigned long portid, n;
+    char *end;
+
+    portid = strtoul(arg, &end, 10);
+    if (end == arg || *end != ':' || portid >= RTE_MAX_ETHPORTS) {
+        return -1;
+    }
+
+    arg = end + 1;
+    n = strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || n == 0 || n > UINT32_MAX) {
+        return -1;
+    }
+
+    reservations[portid] = n;
+    return 0;
+}
+
+int
+daqswitch_mempool_set_overcommit(const char *arg)
+{
+    unsigned long pct;
+    char *end;
+
+    pct = strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || pct < 100 || pct > UINT32_MAX) {
+        return -1;
+    }
+
+    overcommit = pct;
+    return 0;
+}
+
+/* largest cache, a power of 2, keeping the caches of all lcores within
+ * their share of the pool, at least a burst if the pool allows it */
+static unsigned
+cache_size_get(uint32_t size)
+{
+    unsigned cache = RTE_MIN(DAQSWITCH_MBUF_CACHE_SIZE, RTE_MEMPOOL_CACHE_MAX_SIZE);
+    uint64_t nb_lcores = rte_lcore_count();
+
+    /* an lcore cache grows up to 1.5 times its size */
+    while (cache > DAQSWITCH_MBUF_CACHE_MIN &&
+           nb_lcores * cache * 3 / 2 * DAQSWITCH_MBUF_CACHE_SHARE > size) {
+        cache >>= 1;
+    }
+
+    return cache;
+}
+
+static void
+monitor_alarm(__attribute__((unused)) void *arg)
+{
+    struct daqswitch_mempool *p;
+    uint32_t free;
+    unsigned socket;
+
+    for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+        p = &pools[socket];
+        if (p->mp == NULL) {
+            continue;
+        }
+
+        free = rte_mempool_count(p->mp);
+        if (free < p->min_free) {
+            p->min_free = free;
+        }
+
+        if (!p->low && free * 100 < (uint64_t) p->size * DAQSWITCH_MEMPOOL_LOW) {
+            DAQSWITCH_LOG_INFO("mempool of socket %u low: %u of %u mbufs free",
+                               socket, free, p->size);
+            p->low = true;
+        } else if (p->low && free * 100 >= (uint64_t) p->size * DAQSWITCH_MEMPOOL_LOW * 2) {
+            DAQSWITCH_LOG_INFO("mempool of socket %u recovered: %u of %u mbufs free",
+                               socket, free, p->size);
+            p->low = false;
+        }
+    }
+
+    if (rte_eal_alarm_set(DAQSWITCH_MEMPOOL_MONITOR_INTERVAL, monitor_alarm, NULL) < 0) {
+        DAQSWITCH_LOG_ERR("cannot re-arm the mempool monitor");
+    }
+}
+
+/* creates the pool of every socket with ports and hands it to the ports,
+ * the queue counts and sizes must be final, ports given a pool
+ * by the datapath keep it */
+int
+daqswitch_mempool_create(void)
+{
+    struct daqswitch_port_conf *conf;
+    struct daqswitch_mempool *p;
+    uint32_t fill[RTE_MAX_NUMA_NODES];
+    uint64_t reserved;
+    unsigned socket;
+    uint8_t portid;
+    char s[64];
+
+    DAQSWITCH_LOG_ENTRY();
+
+    memset(fill, 0, sizeof(fill));
+
+    DAQSWITCH_PORT_FOREACH(portid) {
+        conf = daqswitch_port_get_config(portid);
+        if (conf->pkt_mbuf_pool != NULL) {
+            continue;
+        }
+
+        p = &pools[DAQSWITCH_PORT_GET_NUMA(portid)];
+        p->reserved += reservations[portid] ? reservations[portid] : DAQSWITCH_MBUFS_PER_PORT;
+        p->nb_ports++;
+        fill[DAQSWITCH_PORT_GET_NUMA(portid)] += conf->nb_rxq * conf->nb_rxd;
+    }
+
+    for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+        p = &pools[socket];
+        if (p->nb_ports == 0) {
+            continue;
+        }
+
+        reserved = (uint64_t) p->reserved * 100 / overcommit;
+        p->cache_size = cache_size_get(RTE_MAX(reserved, fill[socket]));
+        /* rx rings and the lcore caches can hold this many at once */
+        fill[socket] += rte_lcore_count() * p->cache_size * 3 / 2;
+        if (reserved < fill[socket]) {
+            DAQSWITCH_LOG_INFO("mempool of socket %u raised from %" PRIu64 " to %u mbufs to fill the rx rings",
+                               socket, reserved, fill[socket]);
+            reserved = fill[socket];
+        }
+        if (reserved > UINT32_MAX - p->cache_size) {
+            DAQSWITCH_LOG_ERR_AND_RETURN("mempool of socket %u too large", socket);
+        }
+
+        /* a multiple of the cache size, as advised for rte_mempool */
+        p->size = RTE_ALIGN_CEIL((uint32_t) reserved, p->cache_size);
+        p->min_free = p->size;
+
+        snprintf(s, sizeof(s), "mempool_s%u", socket);
+        DAQSWITCH_LOG_INFO("creating %s: %u mbufs for %u port(s) reserving %u, cache %u",
+                           s, p->size, p->nb_ports, p->reserved, p->cache_size);
+        p->mp = rte_mempool_create(s,
+                                   p->size,
+                                   DAQSWITCH_MBUF_SIZE,
+                                   p->cache_size,
+                                   sizeof(struct rte_pktmbuf_pool_private),
+                                   rte_pktmbuf_pool_init, NULL,
+                                   rte_pktmbuf_init, NULL,
+                                   socket,
+                                   0);
+        if (p->mp == NULL) {
+            DAQSWITCH_LOG_ERR_AND_RETURN("failed to create mempool: err=%d, socket=%u", rte_errno, socket);
+        }
+    }
+
+    DAQSWITCH_PORT_FOREACH(portid) {
+        conf = daqswitch_port_get_config(portid);
+        if (conf->pkt_mbuf_pool == NULL) {
+            conf->pkt_mbuf_pool = pools[DAQSWITCH_PORT_GET_NUMA(portid)].mp;
+        }
+    }
+
+    if (rte_eal_alarm_set(DAQSWITCH_MEMPOOL_MONITOR_INTERVAL, monitor_alarm, NULL) < 0) {
+        DAQSWITCH_LOG_ERR_AND_RETURN("cannot start the mempool monitor");
+    }
+
+    DAQSWITCH_LOG_EXIT();
+
+    return DAQSWITCH_SUCCESS;
+
+error:
+    return DAQSWITCH_ERR;
+}
+
+/* occupancy of the pools, the lowest free count seen since start
+ * and the packets dropped by the ports of the socket for lack of mbufs */
+void
+daqswitch_mempool_dump(void)
+{
+    struct daqswitch_mempool *p;
+    struct rte_eth_stats stats;
+    uint64_t nombuf;
+    uint32_t free;
+    unsigned socket;
+    uint8_t portid;
+
+    printf("+--------+------------+------------+-------+------------+------------+------------+--------------+\n");
+    printf("| Socket |       Size |   Reserved | Cache |     In use |       Free |   Min free |   Rx no mbuf |\n");
+    printf("+--------+------------+------------+-------+------------+------------+------------+--------------+\n");
+
+    for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+        p = &pools[socket];
+        if (p->mp == NULL) {
+            continue;
+        }
+
+        nombuf = 0;
+        DAQSWITCH_PORT_FOREACH(portid) {
+            if (daqswitch_port_get_config(portid)->pkt_mbuf_pool == p->mp) {
+                daqswitch_port_stats_get(portid, &stats);
+                nombuf += stats.rx_nombuf;
+            }
+        }
+
+        free = rte_mempool_count(p->mp);
+        printf("| %6u | %10u | %10u | %5u | %10u | %10u | %10u | %12" PRIu64 " |\n",
+               socket, p->size, p->reserved, p->cache_size,
+               p->size - free, free, p->min_free, nombuf);
+    }
+
+    printf("+--------+------------+------------+-------+------------+------------+------------+--------------+\n");
+}
@@ -0,0 +1,42 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DAQSWITCH_MEMPOOL_H
+#define DAQSWITCH_MEMPOOL_H
+
+#include <stdint.h>
+
+#include <rte_mempool.h>
+
+/* mbuf pools, one shared by the ports of each numa node
+ *
+ * every port reserves a number of mbufs (DAQSWITCH_MBUFS_PER_PORT unless
+ * set with --mbufs), the pool of a socket holds the reservations of its
+ * ports divided by the overcommit ratio, so idle ports lend their share
+ * to the busy ones, but never less than what fills all rx rings
+ * the per lcore cache is sized so that the caches of all lcores together
+ * hold a small part of the pool only */
+#ifndef DAQSWITCH_MBUF_OVERCOMMIT
+    #define DAQSWITCH_MBUF_OVERCOMMIT                                                          200 /* % */
+#endif
+/* the lcore caches hold at most 1/DAQSWITCH_MBUF_CACHE_SHARE of a pool */
+#define DAQSWITCH_MBUF_CACHE_SHARE                                                               8
+#define DAQSWITCH_MBUF_CACHE_MIN                                                                32
+/* occupancy sampling, a pool with less free mbufs than the threshold is logged */
+#define DAQSWITCH_MEMPOOL_MONITOR_INTERVAL                                                  100000 /* us */
+#define DAQSWITCH_MEMPOOL_LOW                                                                   10 /* % free */
+
+int daqswitch_mempool_set_reservation(const char *arg);
+int daqswitch_mempool_set_overcommit(const char *arg);
+int daqswitch_mempool_create(void);
+void daqswitch_mempool_dump(void);
+
+#endif /* DAQSWITCH_MEMPOOL_H */
@@ -9,9 +9,12 @@
  *
  * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
  */
+#include <string.h>
+
 #include <rte_ethdev.h>
 #include <rte_config.h>
 #include <rte_errno.h>
+#include <rte_spinlock.h>
 
 #include "../common/common.h"
 
@@ -20,6 +23,11 @@
 
 static struct daqswitch_port_conf port_conf[RTE_MAX_ETHPORTS];
 
+/* the pmds add their clear-on-read registers into the device stats
+ * without locking, so the readers on the cli and the alarm threads
+ * go one at a time */
+static rte_spinlock_t port_stats_lock = RTE_SPINLOCK_INITIALIZER;
+
 static struct daqswitch_port_conf port_conf_default = {
     .rte_port_conf = {
         .rxmode = {
@@ -45,6 +53,8 @@ static struct daqswitch_port_conf port_conf_default = {
 
     .fdir_enabled = false,
 
+    .rss_nb_queues = 0,
+
 };
 
 /* returns per port configuration */
@@ -55,6 +65,23 @@ daqswitch_port_get_config(uint8_t portid)
     return &port_conf[portid];
 }
 
+/* nic counters of a port, the only reader of the device stats */
+void
+daqswitch_port_stats_get(uint8_t portid, struct rte_eth_stats *stats)
+{
+    rte_spinlock_lock(&port_stats_lock);
+    rte_eth_stats_get(portid, stats);
+    rte_spinlock_unlock(&port_stats_lock);
+}
+
+void
+daqswitch_port_stats_reset(uint8_t portid)
+{
+    rte_spinlock_lock(&port_stats_lock);
+    rte_eth_stats_reset(portid);
+    rte_spinlock_unlock(&port_stats_lock);
+}
+
 /* initialize port */
 int daqswitch_port_init(uint8_t portid)
 {
@@ -64,6 +91,13 @@ int daqswitch_port_init(uint8_t portid)
     /* set default configuration */
     port_conf[portid] = port_conf_default;
 
+    /* the pmd scatters frames longer than the mbuf data room
+     * over a chain of mbufs */
+    if (daqswitch_get_mtu() > ETHER_MTU) {
+        port_conf[portid].rte_port_conf.rxmode.jumbo_frame = 1;
+        port_conf[portid].rte_port_conf.rxmode.max_rx_pkt_len = daqswitch_get_max_frame_len();
+    }
+
     DAQSWITCH_LOG_EXIT();
 
     return DAQSWITCH_SUCCESS;
@@ -74,26 +108,13 @@ int daqswitch_port_configure(uint8_t portid)
 {
     int ret;
     uint16_t queueid;
-	char s[64];
 
     DAQSWITCH_LOG_ENTRY();
     RTE_VERIFY(portid < daqswitch_get_nb_ports());
 
-    /* create per port mempool if it does not exists */
+    /* mempool shared by the ports of the socket, see daqswitch_mempool.h */
     if (port_conf[portid].pkt_mbuf_pool == NULL) {
-        snprintf(s, sizeof(s), "mempool_p%d", portid);
-        port_conf[portid].pkt_mbuf_pool = rte_mempool_create(s,
-                                                             DAQSWITCH_MBUFS_PER_PORT,
-                                                             DAQSWITCH_MBUF_SIZE,
-                                                             DAQSWITCH_MBUF_CACHE_SIZE,
-                                                             sizeof(struct rte_pktmbuf_pool_private),
-                                                             rte_pktmbuf_pool_init, NULL,
-                                                             rte_pktmbuf_init, NULL,
-                                                             DAQSWITCH_PORT_GET_NUMA(portid),
-                                                             0); 
-        if (port_conf[portid].pkt_mbuf_pool == NULL) {
-            DAQSWITCH_LOG_ERR_AND_RETURN("failed to create mempool: err=%d, port=%d", rte_errno, portid);
-        }
+        DAQSWITCH_LOG_ERR_AND_RETURN("no mempool for port %d", portid);
     }
 
     /* configure eth devices */
@@ -109,14 +130,21 @@ int daqswitch_port_configure(uint8_t portid)
      * to which the port is bound
      * tx */
     struct rte_eth_dev_info dev_info;
+    struct rte_eth_txconf txconf;
     rte_eth_dev_info_get(portid, &dev_info);
 
+    /* the default simple tx path cannot send mbuf chains */
+    txconf = dev_info.default_txconf;
+    if (daqswitch_get_max_frame_segs() > 1) {
+        txconf.txq_flags &= ~ETH_TXQ_FLAGS_NOMULTSEGS;
+    }
+
     for (queueid = 0; queueid < port_conf[portid].nb_txq; queueid++) {
         ret = rte_eth_tx_queue_setup(portid,
                                      queueid,
                                      port_conf[portid].nb_txd,
                                      DAQSWITCH_PORT_GET_NUMA(portid),
-                                     &dev_info.default_txconf);
+                                     &txconf);
         DAQSWITCH_LOG_AND_RETURN_ON_ERR("failed to setup tx queue port %d", portid);
     }
     /* rx */
@@ -167,6 +195,28 @@ int daqswitch_port_start(uint8_t portid)
         DAQSWITCH_LOG_AND_RETURN_ON_ERR("cannot set fdir masks: err=%d, port=%d", ret, portid);
     }
 
+    /* restrict rss to the requested queues,
+     * by default the nic spreads over all of them */
+    if (port_conf[portid].rss_nb_queues) {
+        struct rte_eth_dev_info dev_info;
+        struct rte_eth_rss_reta_entry64 reta_conf[ETH_RSS_RETA_SIZE_512 / RTE_RETA_GROUP_SIZE];
+        uint16_t i;
+
+        rte_eth_dev_info_get(portid, &dev_info);
+        RTE_VERIFY(dev_info.reta_size <= ETH_RSS_RETA_SIZE_512);
+
+        DAQSWITCH_LOG_INFO("\tconfiguring rss over %d queues...", port_conf[portid].rss_nb_queues);
+        memset(reta_conf, 0, sizeof(reta_conf));
+        for (i = 0; i < dev_info.reta_size; i++) {
+            reta_conf[i / RTE_RETA_GROUP_SIZE].mask = ~0ULL;
+            reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] =
+                i % port_conf[portid].rss_nb_queues;
+        }
+
+        ret = rte_eth_dev_rss_reta_update(portid, reta_conf, dev_info.reta_size);
+        DAQSWITCH_LOG_AND_RETURN_ON_ERR("cannot update rss reta: err=%d, port=%d", ret, portid);
+    }
+
     /* flow control */
     static struct rte_eth_fc_conf fc_conf = {
         .autoneg    = 1,
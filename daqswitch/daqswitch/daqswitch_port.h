@@ -21,7 +21,16 @@
 
 #define DAQSWITCH_PORT_FOREACH(portid)                              \
     for (portid = 0; portid < daqswitch_get_nb_ports(); portid++)
-#define DAQSWITCH_PORT_GET_NUMA(portid) (DAQSWITCH_NUMA_ON ? (unsigned) rte_eth_dev_socket_id(portid) : 0)
+#define DAQSWITCH_PORT_GET_NUMA(portid) daqswitch_port_get_numa(portid)
+
+/* the socket is unknown (-1) for some devices, these are taken as local to socket 0 */
+static inline unsigned
+daqswitch_port_get_numa(uint8_t portid)
+{
+    int socket = DAQSWITCH_NUMA_ON ? rte_eth_dev_socket_id(portid) : 0;
+
+    return (socket < 0 || socket >= RTE_MAX_NUMA_NODES) ? 0 : (unsigned) socket;
+}
 
 struct daqswitch_port_conf {
     struct rte_eth_conf rte_port_conf;
@@ -41,12 +50,17 @@ struct daqswitch_port_conf {
     struct rte_fdir_masks fdir_masks;
     bool fdir_enabled;
 
+    /* Number of rx queues (starting with 0) in the rss redirection table */
+    uint16_t rss_nb_queues;
+
 } __rte_cache_aligned;
 
 struct daqswitch_port_conf *daqswitch_port_get_config(uint8_t portid);
 int daqswitch_port_init(uint8_t portid);
 int daqswitch_port_configure(uint8_t portid);
 int daqswitch_port_start(uint8_t portid);
+void daqswitch_port_stats_get(uint8_t portid, struct rte_eth_stats *stats);
+void daqswitch_port_stats_reset(uint8_t portid);
 
 static inline int
 daqswitch_port_set_nb_rxq(uint8_t portid, uint16_t nb_rxq)
@@ -126,6 +140,26 @@ daqswitch_port_set_fdir_forwarding(uint8_t portid, struct rte_fdir_masks *masks)
     return DAQSWITCH_SUCCESS;
 };
 
+/* spreads packets not matched by fdir over the first nb_queues rx queues */
+static inline int
+daqswitch_port_set_rss(uint8_t portid, uint64_t rss_hf, uint16_t nb_queues)
+{
+    if (daqswitch_is_initialized()) {
+        DAQSWITCH_LOG_INFO("Cannot configure rss. Daqswitch already initialized");
+        return -1;
+    }
+
+    daqswitch_port_get_config(portid)->rte_port_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+    daqswitch_port_get_config(portid)->rte_port_conf.rx_adv_conf.rss_conf.rss_key = NULL;
+    daqswitch_port_get_config(portid)->rte_port_conf.rx_adv_conf.rss_conf.rss_hf = rss_hf;
+
+    daqswitch_port_get_config(portid)->rss_nb_queues = nb_queues;
+
+    DAQSWITCH_LOG_DEBUG("Port configuration changed, rss_nb_queues=%d", nb_queues);
+
+    return DAQSWITCH_SUCCESS;
+};
+
 static inline bool
 daqswitch_port_is_fdir_enabled(uint8_t portid)
 {
@@ -12,9 +12,46 @@
 #ifndef DP_H
 #define DP_H
 
+#include <stdint.h>
+
+/* flow record, see dp_flow_records_get */
+#define DP_FLOW_RECORD_DEFAULT                                                        0xff
+struct dp_flow_record {
+    uint8_t port_id;
+    /* voq, or DP_FLOW_RECORD_DEFAULT for the default path of the port */
+    uint8_t flow_id;
+    uint8_t req_flow;
+    /* network order, 0 for the default path */
+    uint32_t dest_ip;
+    uint32_t sink_id;
+
+    uint64_t packets;
+    uint64_t bytes;
+    /* tsc of the first and the last packet sent */
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+
+    uint32_t max_depth;
+    uint64_t stall_cycles;
+    uint64_t ecn_marked;
+};
+
 int dp_configure(void);
 int dp_init(void);
 int dp_install_default_tables(void);
 void dp_dump_cfg(void);
+void dp_dump_latency(void);
+void dp_reset_latency(void);
+void dp_dump_tcp(void);
+void dp_reset_tcp(void);
+unsigned dp_flow_records_get(struct dp_flow_record *records, unsigned max);
+int dp_param_set(const char *name, uint32_t value);
+void dp_dump_params(void);
+void dp_dump_lcores(void);
+int dp_balance_lcores(void);
+void dp_dump_tc(void);
+void dp_dump_admission(void);
+int dp_add_tc_rule(const char *kind, uint8_t dscp_min, uint8_t dscp_max,
+                   uint16_t ros_port_min, uint16_t ros_port_max, uint8_t tc);
 
 #endif /* DP_H */
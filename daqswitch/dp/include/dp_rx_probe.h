@@ -0,0 +1,39 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_RX_PROBE_H
+#define DP_RX_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_ethdev.h>
+
+/* emptiness probe of rx queues
+ * the done bit of the next descriptor tells whether a queue holds a
+ * packet, one descriptor read instead of the whole rx burst path
+ * the inline rte_eth_rx_descriptor_done does not check the driver
+ * callback, so support is checked once up front */
+
+static inline bool
+dp_rx_probe_supported(uint8_t port_id)
+{
+    return rte_eth_devices[port_id].dev_ops->rx_descriptor_done != NULL;
+}
+
+/* non-zero if the queue may hold packets */
+static inline int
+dp_rx_probe(uint8_t port_id, uint16_t queue_id)
+{
+    return rte_eth_rx_descriptor_done(port_id, queue_id, 0);
+}
+
+#endif /* DP_RX_PROBE_H */
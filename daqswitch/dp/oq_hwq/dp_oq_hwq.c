@@ -78,6 +78,12 @@
     #define DP_TX_DRAIN_INTERVAL                                                       10  /* us */
 #endif
 #define	MAX_TX_BURST	(MAX_PKT_BURST / 2)
+#define TX_PENDING_MAX	(MAX_PKT_BURST * 4)
+/* pending packets above which a whole RX burst might not fit any more */
+#define TX_PENDING_FULL	(TX_PENDING_MAX - MAX_PKT_BURST)
+#if RTE_MAX_ETHPORTS > 64
+#error "the tx_full mask of an lcore holds 64 ports"
+#endif
 #define NB_SOCKETS 8
 
 #define RTE_TEST_RX_DESC_DEFAULT 2048
@@ -95,9 +101,12 @@
 static uint16_t nb_rxd = RTE_TEST_RX_DESC_DEFAULT;
 static uint16_t nb_txd = RTE_TEST_TX_DESC_DEFAULT;
 
+/* packets waiting for a full NIC TX queue are kept per output interface,
+ * once one of them has no room for another RX burst the lcore stops
+ * polling its RX queues, so the packets wait on the RX rings */
 struct mbuf_table {
 	uint16_t len;
-	struct rte_mbuf *m_table[MAX_PKT_BURST];
+	struct rte_mbuf *m_table[TX_PENDING_MAX];
 };
 
 typedef struct rte_lpm lookup_struct_t;
@@ -122,6 +131,8 @@ struct lcore_conf {
 	struct lcore_rx_queue rx_queue_list[MAX_RX_QUEUE_PER_LCORE];
 	uint16_t tx_queue_id[RTE_MAX_ETHPORTS];
 	struct mbuf_table tx_mbufs[RTE_MAX_ETHPORTS];
+	/* output interfaces above TX_PENDING_FULL, a bit per port */
+	uint64_t tx_full;
 	lookup_struct_t *ipv4_lookup_struct;
 } __rte_cache_aligned;
 static struct lcore_conf lcore_conf[RTE_MAX_LCORE];
@@ -130,115 +141,101 @@ static uint32_t nb_ip_routes = 0;
 
 #define DP_OQ_HWQ_LPM_MAX_RULES 1024
 
-/* Send burst of packets on an output interface */
-static inline int
-send_burst(struct lcore_conf *qconf, uint16_t n, uint8_t port)
+/*
+ * Try to send the pending packets of an output interface once.
+ * Never blocks, packets not accepted by the NIC stay pending.
+ */
+static inline uint16_t
+send_burst(struct lcore_conf *qconf, uint8_t port)
 {
-	struct rte_mbuf **m_table;
-	int ret;
-	uint16_t queueid;
+	struct mbuf_table *txb = &qconf->tx_mbufs[port];
+	uint16_t queueid = qconf->tx_queue_id[port];
+	uint16_t ret;
 
-    queueid = qconf->tx_queue_id[port];
-	m_table = (struct rte_mbuf **)qconf->tx_mbufs[port].m_table;
+	if (txb->len == 0)
+		return 0;
 
-    while (n > 0) {
-        ret = rte_eth_tx_burst(port, queueid, m_table, n);
-        
-        if (likely(ret > 0)) {
-            daqswitch_tx_queue_stats[port][queueid].total_packets += ret;
-            daqswitch_tx_queue_stats[port][queueid].total_bursts++;
+	ret = rte_eth_tx_burst(port, queueid, txb->m_table, txb->len);
+	if (likely(ret > 0)) {
+		daqswitch_tx_queue_stats[port][queueid].total_packets += ret;
+		daqswitch_tx_queue_stats[port][queueid].total_bursts++;
+
+		txb->len -= ret;
+		if (txb->len > 0)
+			memmove(txb->m_table, &txb->m_table[ret],
+				txb->len * sizeof(struct rte_mbuf *));
+		if (txb->len <= TX_PENDING_FULL)
+			qconf->tx_full &= ~(1ULL << port);
+	}
 
-            /* keep tx until all sent, do not drop packets here */ 
-            n -= ret;
-            m_table += ret;
-        }
-    }
+	return ret;
+}
 
-	return 0;
+/*
+ * Append packets to the pending buffer of an output interface.
+ * Never blocks, the RX queues are only polled while every buffer
+ * has room for a whole burst, see tx_congested.
+ */
+static inline void
+send_buffer(struct lcore_conf *qconf, uint8_t port,
+	struct rte_mbuf *m[], uint32_t num)
+{
+	struct mbuf_table *txb = &qconf->tx_mbufs[port];
+
+	rte_memcpy(&txb->m_table[txb->len], m, num * sizeof(struct rte_mbuf *));
+	txb->len += num;
+	if (unlikely(txb->len > TX_PENDING_FULL))
+		qconf->tx_full |= 1ULL << port;
+}
+
+/*
+ * Retry the output interfaces without room for another RX burst,
+ * returns 1 if any of them is still full.
+ */
+static inline int
+tx_congested(struct lcore_conf *qconf)
+{
+	uint64_t full = qconf->tx_full;
+
+	while (full != 0) {
+		send_burst(qconf, __builtin_ctzll(full));
+		full &= full - 1;
+	}
+
+	return qconf->tx_full != 0;
 }
 
 static inline __attribute__((always_inline)) void
 send_packetsx4(struct lcore_conf *qconf, uint8_t port,
 	struct rte_mbuf *m[], uint32_t num)
 {
-	uint32_t len, j, n;
-
-	len = qconf->tx_mbufs[port].len;
+	uint16_t queueid;
+	uint32_t n;
 
 	/*
 	 * If TX buffer for that queue is empty, and we have enough packets,
-	 * then send them straightway.
+	 * then send them straightway, whatever is left becomes pending.
 	 */
-	if (num >= MAX_TX_BURST && len == 0) {
-        while (num > 0) {
-            n = rte_eth_tx_burst(port, qconf->tx_queue_id[port], m, num);
-            
-            if (likely(n > 0)) {
-                daqswitch_tx_queue_stats[port][qconf->tx_queue_id[port]].total_packets += n;
-                daqswitch_tx_queue_stats[port][qconf->tx_queue_id[port]].total_bursts++;
-
-                /* keep tx until all sent, do not drop packets here */ 
-                num -= n;
-                m += n;
-            }
-        }
+	if (num >= MAX_TX_BURST && qconf->tx_mbufs[port].len == 0) {
+		queueid = qconf->tx_queue_id[port];
+		n = rte_eth_tx_burst(port, queueid, m, num);
+		if (likely(n > 0)) {
+			daqswitch_tx_queue_stats[port][queueid].total_packets += n;
+			daqswitch_tx_queue_stats[port][queueid].total_bursts++;
+		}
+		if (n < num)
+			send_buffer(qconf, port, &m[n], num - n);
 		return;
 	}
 
 	/*
 	 * Put packets into TX buffer for that queue.
 	 */
-
-	n = len + num;
-	n = (n > MAX_PKT_BURST) ? MAX_PKT_BURST - len : num;
-
-	j = 0;
-	switch (n % FWDSTEP) {
-	while (j < n) {
-	case 0:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
-		j++;
-	case 3:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
-		j++;
-	case 2:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
-		j++;
-	case 1:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
-		j++;
-	}
-	}
-
-	len += n;
+	send_buffer(qconf, port, m, num);
 
 	/* enough pkts to be sent */
-	if (unlikely(len == MAX_PKT_BURST)) {
-
-		send_burst(qconf, MAX_PKT_BURST, port);
-
-		/* copy rest of the packets into the TX buffer. */
-		len = num - n;
-		j = 0;
-		switch (len % FWDSTEP) {
-		while (j < len) {
-		case 0:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
-			j++;
-		case 3:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
-			j++;
-		case 2:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
-			j++;
-		case 1:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
-			j++;
-		}
-		}
-	}
-
-	qconf->tx_mbufs[port].len = len;
+	if (qconf->tx_mbufs[port].len >= MAX_PKT_BURST)
+		send_burst(qconf, port);
 }
 
 static inline __attribute__((always_inline)) uint16_t
@@ -554,15 +551,19 @@ main_loop(__attribute__((unused)) void *dummy)
 			for (portid = 0; portid < RTE_MAX_ETHPORTS; portid++) {
 				if (qconf->tx_mbufs[portid].len == 0)
 					continue;
-				send_burst(qconf,
-					qconf->tx_mbufs[portid].len,
-					portid);
-				qconf->tx_mbufs[portid].len = 0;
+				send_burst(qconf, portid);
 			}
 
 			prev_tsc = cur_tsc;
 		}
 
+		/*
+		 * Leave the packets on the RX rings while an output
+		 * interface cannot take another burst
+		 */
+		if (unlikely(qconf->tx_full != 0) && tx_congested(qconf))
+			continue;
+
 		/*
 		 * Read packet from RX queues
 		 */
@@ -912,3 +913,83 @@ void
 dp_dump_cfg(void)
 {
 }
+
+/* no latency stats and no tcp monitor in this datapath */
+void
+dp_dump_latency(void)
+{
+}
+
+void
+dp_reset_latency(void)
+{
+}
+
+void
+dp_dump_tcp(void)
+{
+}
+
+void
+dp_reset_tcp(void)
+{
+}
+
+/* no flow records in this datapath */
+unsigned
+dp_flow_records_get(__attribute__((unused)) struct dp_flow_record *records,
+                    __attribute__((unused)) unsigned max)
+{
+    return 0;
+}
+
+/* no runtime tunables in this datapath */
+int
+dp_param_set(__attribute__((unused)) const char *name,
+             __attribute__((unused)) uint32_t value)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_params(void)
+{
+}
+
+void
+dp_dump_lcores(void)
+{
+    printf("not supported by this datapath\n");
+}
+
+int
+dp_balance_lcores(void)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_tc(void)
+{
+    printf("not supported by this datapath\n");
+}
+
+int
+dp_add_tc_rule(__attribute__((unused)) const char *kind,
+               __attribute__((unused)) uint8_t dscp_min,
+               __attribute__((unused)) uint8_t dscp_max,
+               __attribute__((unused)) uint16_t ros_port_min,
+               __attribute__((unused)) uint16_t ros_port_max,
+               __attribute__((unused)) uint8_t tc)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_admission(void)
+{
+    printf("not supported by this datapath\n");
+}
@@ -71,6 +71,7 @@
 #include "../../stats/stats.h"
 #include "../../common/common.h"
 #include "../include/dp.h"
+#include "../include/dp_rx_probe.h"
 
 #define MAX_PKT_BURST 32
 
@@ -127,6 +128,10 @@ main_loop(__attribute__((unused)) void *dummy)
 	uint32_t nb_rx;
 	struct lcore_conf *qconf;
 
+    /* rx queues known to hold packets, per tx queue, they skip the probe */
+    uint64_t active[MAX_TX_QUEUE_PER_LCORE] = {0};
+    bool probe[RTE_MAX_ETHPORTS];
+
 #if DP_RX_POLL_INTERVAL
     const uint64_t poll_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * DP_RX_POLL_INTERVAL;
     uint64_t prev_tsc[MAX_TX_QUEUE_PER_LCORE] = {0};
@@ -143,6 +148,16 @@ main_loop(__attribute__((unused)) void *dummy)
 
 	DP_LOG_INFO("entering main loop on lcore %u", lcore_id);
 
+    RTE_BUILD_BUG_ON(MAX_RX_QUEUE_PER_PORT > 64);
+
+    for (j = 0; j < RTE_MAX_ETHPORTS; j++) {
+#ifndef DP_RX_PROBE_DISABLE
+        probe[j] = j < rte_eth_dev_count() && dp_rx_probe_supported(j);
+#else
+        probe[j] = false;
+#endif
+    }
+
 	for (i = 0; i < qconf->n_tx_queue; i++) {
         cur_txq = &qconf->tx_queue_list[i];
         nb_ports = cur_txq->n_rx_port;
@@ -170,9 +185,22 @@ main_loop(__attribute__((unused)) void *dummy)
 
                 for (j = 0; j < nb_ports; j++) {
 
+                    /* an idle queue is probed before running the rx burst */
+                    if (probe[cur_txq->rx_port_ids[j]] && !(active[i] & (1ULL << j)) &&
+                        dp_rx_probe(cur_txq->rx_port_ids[j], cur_txq->rx_queue_id) == 0) {
+                        continue;
+                    }
+
                     nb_rx = rte_eth_rx_burst(cur_txq->rx_port_ids[j], cur_txq->rx_queue_id,
                                              pkts_burst, MAX_PKT_BURST);
 
+                    /* a full burst leaves packets behind */
+                    if (nb_rx == MAX_PKT_BURST) {
+                        active[i] |= 1ULL << j;
+                    } else {
+                        active[i] &= ~(1ULL << j);
+                    }
+
                     if (likely(nb_rx > 0)) {
 #if DP_RX_POLL_INTERVAL
                         /* most probably there are more packets in the rx-queue
@@ -502,3 +530,83 @@ void
 dp_dump_cfg(void)
 {
 }
+
+/* no latency stats and no tcp monitor in this datapath */
+void
+dp_dump_latency(void)
+{
+}
+
+void
+dp_reset_latency(void)
+{
+}
+
+void
+dp_dump_tcp(void)
+{
+}
+
+void
+dp_reset_tcp(void)
+{
+}
+
+/* no flow records in this datapath */
+unsigned
+dp_flow_records_get(__attribute__((unused)) struct dp_flow_record *records,
+                    __attribute__((unused)) unsigned max)
+{
+    return 0;
+}
+
+/* no runtime tunables in this datapath */
+int
+dp_param_set(__attribute__((unused)) const char *name,
+             __attribute__((unused)) uint32_t value)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_params(void)
+{
+}
+
+void
+dp_dump_lcores(void)
+{
+    printf("not supported by this datapath\n");
+}
+
+int
+dp_balance_lcores(void)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_tc(void)
+{
+    printf("not supported by this datapath\n");
+}
+
+int
+dp_add_tc_rule(__attribute__((unused)) const char *kind,
+               __attribute__((unused)) uint8_t dscp_min,
+               __attribute__((unused)) uint8_t dscp_max,
+               __attribute__((unused)) uint16_t ros_port_min,
+               __attribute__((unused)) uint16_t ros_port_max,
+               __attribute__((unused)) uint8_t tc)
+{
+    printf("not supported by this datapath\n");
+    return -1;
+}
+
+void
+dp_dump_admission(void)
+{
+    printf("not supported by this datapath\n");
+}
@@ -0,0 +1,86 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include "../../common/common.h"
+#include "../include/dp.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tunables.h"
+#include "dp_admit.h"
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+struct dp_adm_dcm dp_adm[DP_ADM_DCMS_MAX];
+
+/* open addressing, slots are never freed, the tx lcores look up
+ * without a lock, so the address is published last
+ * must be called with the provision lock held */
+uint16_t
+dp_adm_learn(uint32_t ip)
+{
+    uint32_t i, slot;
+
+    for (i = 0; i < DP_ADM_DCMS_MAX; i++) {
+        slot = (dp_adm_hash(ip) + i) & (DP_ADM_DCMS_MAX - 1);
+        if (dp_adm[slot].ip == ip) {
+            return slot;
+        }
+        if (dp_adm[slot].ip == 0) {
+            rte_atomic64_init(&dp_adm[slot].outstanding);
+            rte_atomic64_init(&dp_adm[slot].held);
+            rte_atomic64_init(&dp_adm[slot].expired);
+            rte_compiler_barrier();
+            dp_adm[slot].ip = ip;
+            return slot;
+        }
+    }
+
+    DP_LOG_INFO("warning: admission table full, requests of dcm 0x%08x are not gated",
+                rte_be_to_cpu_32(ip));
+    return DP_ADM_SLOT_NONE;
+}
+
+void
+dp_dump_admission(void)
+{
+    struct in_addr addr;
+    uint32_t slot;
+    int64_t outstanding;
+
+    printf("admission control %s, budget %u KB, fragment %u B, hold max %u us\n",
+           dp_tunables.t.adm_budget ? "on" : "off", dp_tunables.t.adm_budget,
+           dp_tunables.t.adm_fragment_size, dp_tunables.t.adm_hold_max);
+
+    printf("+-----------------+----------------------+----------------------+----------------------+\n");
+    printf("| Dcm             | Outstanding [B]      | Held requests        | Expired holds        |\n");
+    printf("+-----------------+----------------------+----------------------+----------------------+\n");
+    for (slot = 0; slot < DP_ADM_DCMS_MAX; slot++) {
+        if (dp_adm[slot].ip == 0) {
+            continue;
+        }
+        addr.s_addr = dp_adm[slot].ip;
+        outstanding = rte_atomic64_read(&dp_adm[slot].outstanding);
+        printf("| %-15s | %20" PRId64 " | %20" PRId64 " | %20" PRId64 " |\n",
+               inet_ntoa(addr), outstanding < 0 ? 0 : outstanding,
+               rte_atomic64_read(&dp_adm[slot].held),
+               rte_atomic64_read(&dp_adm[slot].expired));
+    }
+    printf("+-----------------+----------------------+----------------------+----------------------+\n");
+}
+#else
+void
+dp_dump_admission(void)
+{
+}
+#endif
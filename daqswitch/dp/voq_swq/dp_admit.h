@@ -0,0 +1,112 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_ADMIT_H
+#define DP_ADMIT_H
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+#include <rte_atomic.h>
+
+/* request admission control
+ *
+ * every fragment request forwarded to a ros is charged to the dcm which
+ * sent it with the expected size of the response (adm_fragment_size),
+ * the bytes sent towards the dcm are credited back, a request of a dcm
+ * with adm_budget or more bytes outstanding is held at the head of its
+ * voq lane until enough of the responses have left, so an event builder
+ * cannot pull more into its port than the port can buffer
+ * a request is held for adm_hold_max at most, the charge is an estimate
+ * and an overestimate would otherwise stall the dcm for good
+ * the dcms are learned by the default lcores when they provision the
+ * voqs of a data flow */
+#define DP_ADM_DCMS_MAX                                                                1024
+#define DP_ADM_SLOT_NONE                                                         UINT16_MAX
+
+/* defaults of the runtime tunables, see dp_tunables.h */
+#ifndef DP_ADM_BUDGET
+    #define DP_ADM_BUDGET                                                                 0 /* KB */
+#endif
+#ifndef DP_ADM_FRAGMENT_SIZE
+    #define DP_ADM_FRAGMENT_SIZE                                                       1500 /* bytes */
+#endif
+#ifndef DP_ADM_HOLD_MAX
+    #define DP_ADM_HOLD_MAX                                                            1000 /* us */
+#endif
+
+struct dp_adm_dcm {
+    /* network order, 0 for a free slot, written once */
+    volatile uint32_t ip;
+    /* charged by the tx lcores of the ros ports,
+     * credited by the ones of the dcm port */
+    rte_atomic64_t outstanding;
+    /* requests held, and the ones let through after adm_hold_max */
+    rte_atomic64_t held;
+    rte_atomic64_t expired;
+} __rte_cache_aligned;
+
+extern struct dp_adm_dcm dp_adm[DP_ADM_DCMS_MAX];
+
+static inline uint32_t
+dp_adm_hash(uint32_t ip)
+{
+    return (ip * 2654435761U) >> 22;
+}
+
+/* slot of a dcm, DP_ADM_SLOT_NONE if unknown */
+static inline uint16_t
+dp_adm_lookup(uint32_t ip)
+{
+    uint32_t i, slot;
+
+    for (i = 0; i < DP_ADM_DCMS_MAX; i++) {
+        slot = (dp_adm_hash(ip) + i) & (DP_ADM_DCMS_MAX - 1);
+        if (dp_adm[slot].ip == ip) {
+            return slot;
+        }
+        if (dp_adm[slot].ip == 0) {
+            break;
+        }
+    }
+
+    return DP_ADM_SLOT_NONE;
+}
+
+/* charges a request to a dcm unless it is at its budget or beyond,
+ * credits beyond the last charge are dropped, so the balance never goes
+ * below what is really outstanding, returns 1 if charged */
+static inline int
+dp_adm_charge(struct dp_adm_dcm *dcm, int64_t budget, uint32_t size, int force)
+{
+    int64_t cur, base;
+
+    do {
+        cur = rte_atomic64_read(&dcm->outstanding);
+        base = cur < 0 ? 0 : cur;
+        if (!force && base >= budget) {
+            return 0;
+        }
+    } while (!rte_atomic64_cmpset((volatile uint64_t *) &dcm->outstanding.cnt,
+                                  (uint64_t) cur, (uint64_t) (base + size)));
+
+    return 1;
+}
+
+static inline void
+dp_adm_credit(uint16_t slot, uint64_t bytes)
+{
+    rte_atomic64_sub(&dp_adm[slot].outstanding, (int64_t) bytes);
+}
+
+uint16_t dp_adm_learn(uint32_t ip);
+
+#endif /* DP_ADMIT_H */
@@ -0,0 +1,432 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_alarm.h>
+#include <rte_spinlock.h>
+#include <rte_atomic.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
+#include "../include/dp.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tunables.h"
+#include "dp_plan.h"
+
+/* load balancing of data lcores
+ *
+ * every data lcore counts the cycles of its port rounds, all of them and
+ * those which moved packets, per lcore and per port (part) served, the
+ * balancer compares two snapshots taken a window apart and moves a port
+ * from the busiest to the least busy lcore of the same type on the socket
+ * of the port, see dp_plan.h
+ * a port is handed over with the mailbox of the lcores: the current one
+ * releases it, a tx lcore after sending all packets it holds, and only
+ * then the new one adopts it, so each voq lane keeps a single producer
+ * and a single consumer at any time and no packet is lost
+ * a tx lcore serving a single hot port splits it instead, the odd data
+ * voqs move to another lcore and a separate tx queue, see DP_BALANCE_SPLIT */
+#ifndef DAQ_DATA_FLOWS_DISABLE
+
+/* window of a balancing run started from the command line */
+#define DP_BALANCE_WINDOW                                                           100000 /* us */
+/* period of the check of the balance_interval tunable */
+#define DP_BALANCE_TICK                                                             100000 /* us */
+/* utilization gap between two lcores worth a move */
+#ifndef DP_BALANCE_THRESHOLD
+    #define DP_BALANCE_THRESHOLD                                                        20 /* % */
+#endif
+/* utilization of the busiest lcore below which nothing is moved */
+#ifndef DP_BALANCE_MIN_LOAD
+    #define DP_BALANCE_MIN_LOAD                                                         50 /* % */
+#endif
+/* a lone hot port of a tx lcore is split over two lcores, not with the
+ * event latency or the tcp monitor built in, their tables are per port
+ * and written by the single tx lcore of the port */
+#if defined(DP_EVENT_LATENCY) || defined(DP_TCP_MONITOR)
+    #define DP_BALANCE_SPLIT                                                             0
+#else
+    #define DP_BALANCE_SPLIT                                                             1
+#endif
+/* mailbox poll period of the balancer */
+#define DP_BALANCE_MBOX_POLL                                                            10 /* us */
+/* wait for an lcore to take a command, above DP_MBOX_DRAIN_TIMEOUT */
+#ifndef DP_BALANCE_MBOX_TIMEOUT
+    #define DP_BALANCE_MBOX_TIMEOUT                                                    100 /* ms */
+#endif
+
+#define DP_VOQ_MASK_EVEN                                             0x5555555555555555ULL
+#define DP_VOQ_MASK_ODD                                              0xAAAAAAAAAAAAAAAAULL
+
+struct lcore_snapshot {
+    uint64_t busy_tsc;
+    uint64_t total_tsc;
+    uint64_t port_busy_tsc[DP_LCORE_PORT_MAX];
+};
+
+static struct lcore_snapshot snapshots[DAQSWITCH_MAX_LCORES];
+static uint64_t last_balance_tsc;
+static rte_spinlock_t balance_lock = RTE_SPINLOCK_INITIALIZER;
+
+static inline bool
+lcore_is_data(const struct dp_lcore_params *lp)
+{
+    return lp->type == DP_LCORE_TYPE_DATA_RX || lp->type == DP_LCORE_TYPE_DATA_TX;
+}
+
+static inline uint64_t
+port_busy_tsc(const struct dp_lcore_params *lp, uint8_t port_idx)
+{
+    return lp->type == DP_LCORE_TYPE_DATA_RX ? lp->rx.port_list[port_idx].busy_tsc :
+                                               lp->tx.port_list[port_idx].busy_tsc;
+}
+
+static inline uint8_t
+port_id_get(const struct dp_lcore_params *lp, uint8_t port_idx)
+{
+    return lp->type == DP_LCORE_TYPE_DATA_RX ? lp->rx.port_list[port_idx].port_id :
+                                               lp->tx.port_list[port_idx].port_id;
+}
+
+static void
+snapshot_take(struct lcore_snapshot *s)
+{
+    struct dp_lcore_params *lp;
+    uint32_t i;
+    uint8_t j;
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (!lcore_is_data(lp)) {
+            continue;
+        }
+        s[i].busy_tsc = lp->load.busy_tsc;
+        s[i].total_tsc = lp->load.total_tsc;
+        for (j = 0; j < lp->nb_ports; j++) {
+            s[i].port_busy_tsc[j] = port_busy_tsc(lp, j);
+        }
+    }
+}
+
+/* share of the window in per mille, busy of a port is scaled by the
+ * window of its lcore */
+static inline uint32_t
+load_permille(uint64_t busy, uint64_t total)
+{
+    return total ? (uint32_t) (busy * 1000 / total) : 0;
+}
+
+/* posts a command and waits for the lcore to serve it, a command not
+ * taken within DP_BALANCE_MBOX_TIMEOUT is withdrawn, one taken is waited
+ * for as the lcore bounds its work on it */
+static int
+mbox_post(struct dp_lcore_params *lp, enum dp_mbox_cmd cmd, uint8_t port_id,
+          uint64_t voq_mask, uint16_t queue_base)
+{
+    struct dp_lcore_mbox *mbox = &lp->mbox;
+    unsigned waited = 0;
+
+    RTE_VERIFY(mbox->cmd == DP_MBOX_NONE);
+
+    mbox->port_id = port_id;
+    mbox->voq_mask = voq_mask;
+    mbox->queue_base = queue_base;
+    mbox->ret = DP_ERR;
+    rte_compiler_barrier();
+    mbox->cmd = cmd;
+
+    while (mbox->cmd != DP_MBOX_NONE) {
+        if (waited >= DP_BALANCE_MBOX_TIMEOUT * 1000 &&
+            rte_atomic32_cmpset(&mbox->cmd, cmd, DP_MBOX_NONE)) {
+            DP_LOG_ERR("lcore %u did not take mailbox command %u for port %u",
+                       lp->id, cmd, port_id);
+            return DP_ERR;
+        }
+        rte_delay_us(DP_BALANCE_MBOX_POLL);
+        waited += DP_BALANCE_MBOX_POLL;
+    }
+
+    rte_compiler_barrier();
+    return mbox->ret;
+}
+
+/* moves a port (part) from an lcore to another one of the same type,
+ * the port stays where it is if the current lcore does not release it,
+ * it goes back there if the new one does not adopt it */
+static int
+port_move(struct dp_lcore_params *from, struct dp_lcore_params *to, uint8_t port_idx)
+{
+    struct lcore_data_tx_port_conf conf;
+    uint8_t port_id = port_id_get(from, port_idx);
+
+    DP_LOG_INFO("moving port %u from lcore %u to lcore %u", port_id, from->id, to->id);
+
+    /* the conf is gone once released */
+    memset(&conf, 0, sizeof(conf));
+    if (from->type == DP_LCORE_TYPE_DATA_TX) {
+        conf = from->tx.port_list[port_idx];
+    }
+
+    if (mbox_post(from, DP_MBOX_RELEASE, port_id, 0, 0) != DP_SUCCESS) {
+        DP_LOG_INFO("warning: lcore %u keeps port %u, its packets were not sent in time",
+                    from->id, port_id);
+        return DP_ERR;
+    }
+
+    if (mbox_post(to, DP_MBOX_ADOPT, port_id, conf.voq_mask, conf.queue_base) != DP_SUCCESS &&
+        mbox_post(from, DP_MBOX_ADOPT, port_id, conf.voq_mask, conf.queue_base) != DP_SUCCESS) {
+        DP_LOG_ERR("port %u not served by any lcore", port_id);
+    }
+
+    return DP_SUCCESS;
+}
+
+/* splits the single port of a tx lcore, the lcore keeps the even voqs,
+ * the odd ones go to the other lcore and the other set of class queues */
+static int
+port_split(struct dp_lcore_params *from, struct dp_lcore_params *to)
+{
+    struct lcore_data_tx_port_conf *conf = &from->tx.port_list[0];
+    uint16_t queue_base = conf->queue_base == DP_PORT_TXQ_ID_TC(0) ?
+                          DP_PORT_TXQ_ID_TC_SPLIT(0) : DP_PORT_TXQ_ID_TC(0);
+
+    DP_LOG_INFO("splitting port %u of lcore %u with lcore %u",
+                conf->port_id, from->id, to->id);
+
+    if (mbox_post(from, DP_MBOX_SET_MASK, conf->port_id, DP_VOQ_MASK_EVEN, 0) != DP_SUCCESS) {
+        DP_LOG_INFO("warning: port %u not split, its packets were not sent in time",
+                    conf->port_id);
+        return DP_ERR;
+    }
+
+    /* the odd voqs go back if the other lcore does not take them */
+    if (mbox_post(to, DP_MBOX_ADOPT, conf->port_id, DP_VOQ_MASK_ODD, queue_base) != DP_SUCCESS &&
+        mbox_post(from, DP_MBOX_ADOPT, conf->port_id, DP_VOQ_MASK_ODD, 0) != DP_SUCCESS) {
+        DP_LOG_ERR("odd voqs of port %u not served by any lcore", conf->port_id);
+    }
+
+    return DP_SUCCESS;
+}
+
+/* a single move for the given lcore type, based on the load since the
+ * snapshot in prev, returns 1 if anything moved */
+static int
+balance_type(enum dp_lcore_type type, const struct lcore_snapshot *prev)
+{
+    struct dp_lcore_params *hot = NULL, *cold, *lp;
+    const struct lcore_snapshot *s;
+    uint32_t load[DAQSWITCH_MAX_LCORES];
+    uint32_t hot_idx = 0, i, gap = 0, part, best_part = 0, best_diff = UINT32_MAX, diff;
+    struct dp_lcore_params *best_to = NULL;
+    unsigned socket;
+    uint8_t j, best_idx = 0, port_id;
+    uint64_t total;
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (lp->type != type) {
+            continue;
+        }
+        s = &prev[i];
+        load[i] = load_permille(lp->load.busy_tsc - s->busy_tsc,
+                                lp->load.total_tsc - s->total_tsc);
+        if (hot == NULL || load[i] > load[hot_idx]) {
+            hot = lp;
+            hot_idx = i;
+        }
+    }
+
+    if (hot == NULL || hot->nb_ports == 0 || load[hot_idx] < DP_BALANCE_MIN_LOAD * 10) {
+        return 0;
+    }
+
+    total = hot->load.total_tsc - prev[hot_idx].total_tsc;
+
+    /* the part closest to half of the gap with the least busy lcore
+     * of the socket of the port, a larger one would only swap the roles */
+    for (j = 0; j < hot->nb_ports; j++) {
+        port_id = port_id_get(hot, j);
+        socket = dp_plan.port_socket[port_id];
+        part = load_permille(port_busy_tsc(hot, j) - prev[hot_idx].port_busy_tsc[j], total);
+
+        cold = NULL;
+        for (i = 0; i < dp.nb_lcores; i++) {
+            lp = &dp.lcores[i];
+            if (lp->type != type || lp == hot || lp->nb_ports >= DP_LCORE_PORT_MAX ||
+                (DAQSWITCH_NUMA_ON && rte_lcore_to_socket_id(lp->id) != socket)) {
+                continue;
+            }
+            if (cold == NULL || load[i] < gap) {
+                cold = lp;
+                gap = load[i];
+            }
+        }
+        if (cold == NULL) {
+            continue;
+        }
+
+        gap = load[hot_idx] - gap;
+        if (gap < DP_BALANCE_THRESHOLD * 10) {
+            continue;
+        }
+
+        /* a lone port is split, moving it would not help */
+        if (hot->nb_ports == 1) {
+            if (DP_BALANCE_SPLIT && type == DP_LCORE_TYPE_DATA_TX &&
+                hot->tx.port_list[0].voq_mask == UINT64_MAX) {
+                return port_split(hot, cold) == DP_SUCCESS;
+            }
+            continue;
+        }
+
+        if (part == 0 || part >= gap) {
+            continue;
+        }
+        diff = gap > 2 * part ? gap - 2 * part : 2 * part - gap;
+        if (diff < best_diff) {
+            best_diff = diff;
+            best_part = part;
+            best_idx = j;
+            best_to = cold;
+        }
+    }
+
+    if (best_to == NULL) {
+        return 0;
+    }
+
+    DP_LOG_DEBUG("lcore %u load %u.%u%%, port part %u.%u%%", hot->id,
+                 load[hot_idx] / 10, load[hot_idx] % 10, best_part / 10, best_part % 10);
+    return port_move(hot, best_to, best_idx) == DP_SUCCESS;
+}
+
+/* a balancing run over the load since the last snapshot */
+static int
+balance_run(void)
+{
+    int moved;
+
+    moved = balance_type(DP_LCORE_TYPE_DATA_RX, snapshots);
+    moved += balance_type(DP_LCORE_TYPE_DATA_TX, snapshots);
+
+    snapshot_take(snapshots);
+    last_balance_tsc = rte_rdtsc();
+
+    return moved;
+}
+
+int
+dp_balance_lcores(void)
+{
+    int moved;
+
+    rte_spinlock_lock(&balance_lock);
+
+    snapshot_take(snapshots);
+    rte_delay_us(DP_BALANCE_WINDOW);
+    moved = balance_run();
+
+    rte_spinlock_unlock(&balance_lock);
+
+    printf("%d port(s) moved\n", moved);
+
+    return DP_SUCCESS;
+}
+
+static void
+balance_alarm(__attribute__((unused)) void *arg)
+{
+    uint32_t interval = dp_tunables.t.balance_interval;
+
+    if (interval > 0 && rte_spinlock_trylock(&balance_lock)) {
+        if (rte_rdtsc() - last_balance_tsc >= interval * (rte_get_tsc_hz() / MS_PER_S)) {
+            balance_run();
+        }
+        rte_spinlock_unlock(&balance_lock);
+    }
+
+    if (rte_eal_alarm_set(DP_BALANCE_TICK, balance_alarm, NULL) < 0) {
+        DP_LOG_ERR("cannot re-arm the balancer, automatic balancing stopped");
+    }
+}
+
+int
+dp_balance_init(void)
+{
+    snapshot_take(snapshots);
+    last_balance_tsc = rte_rdtsc();
+
+    return rte_eal_alarm_set(DP_BALANCE_TICK, balance_alarm, NULL) < 0 ? DP_ERR : DP_SUCCESS;
+}
+
+void
+dp_dump_lcores(void)
+{
+    struct dp_lcore_params *lp;
+    uint32_t i;
+    uint8_t j;
+
+    printf("+-------+------+--------+------+--------------------+---------+\n");
+    printf("| Lcore | Type | Load %% | Port | Voqs               | Txqs    |\n");
+    printf("+-------+------+--------+------+--------------------+---------+\n");
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (!lcore_is_data(lp)) {
+            continue;
+        }
+
+        /* load since the last balancing run */
+        printf("| %5u | %4s | %6.1f |", lp->id,
+               lp->type == DP_LCORE_TYPE_DATA_RX ? "rx" : "tx",
+               load_permille(lp->load.busy_tsc - snapshots[i].busy_tsc,
+                             lp->load.total_tsc - snapshots[i].total_tsc) / 10.0);
+
+        if (lp->nb_ports == 0) {
+            printf("      |                    |         |\n");
+        }
+
+        for (j = 0; j < lp->nb_ports; j++) {
+            if (j > 0) {
+                printf("|       |      |        |");
+            }
+            if (lp->type == DP_LCORE_TYPE_DATA_RX) {
+                printf(" %4u |                all |       - |\n", lp->rx.port_list[j].port_id);
+            } else {
+                printf(" %4u | 0x%016" PRIx64 " | %3u-%-3u |\n",
+                       lp->tx.port_list[j].port_id,
+                       lp->tx.port_list[j].voq_mask,
+                       lp->tx.port_list[j].queue_base,
+                       lp->tx.port_list[j].queue_base + DP_TC_MAX - 1);
+            }
+        }
+    }
+
+    printf("+-------+------+--------+------+--------------------+---------+\n");
+}
+#else
+int
+dp_balance_lcores(void)
+{
+    return DP_SUCCESS;
+}
+
+void
+dp_dump_lcores(void)
+{
+}
+#endif
@@ -0,0 +1,207 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+
+#include <rte_malloc.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_byteorder.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
+#include "../../pipeline/pipeline.h"
+#include "../../stats/stats_hist.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tdaq.h"
+#include "dp_event.h"
+
+#ifdef DP_EVENT_LATENCY
+
+static struct dp_tdaq_req *event_reqs[DAQSWITCH_MAX_PORTS];
+static struct dp_tdaq_conn *event_conns[DAQSWITCH_MAX_PORTS];
+
+/* request to completion time per dcm (data voq on the dcm port)
+ * and per pair of dcm and ros ports, written by the tx lcore of the dcm port */
+static struct stats_hist *event_dcm_hist[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
+static struct stats_hist *event_ros_hist[DAQSWITCH_MAX_PORTS][DAQSWITCH_MAX_PORTS];
+
+/* a response being accounted for */
+struct event_resp {
+    uint8_t port_id;
+    uint8_t ros_port_id;
+    uint32_t flow_id;
+    uint64_t now;
+};
+
+/* remembers the rx tsc of fragment requests leaving through a ros port,
+ * the requests of a ros port are written by its tx lcore only */
+static inline void
+event_req_tx(uint8_t port_id, struct rte_mbuf *pkt)
+{
+    struct ipv4_hdr *ip_hdr;
+    const struct tdaq_hdr *hdr;
+    struct tdaq_hdr hdr_buf;
+
+    hdr = dp_tdaq_req_hdr(pkt, &ip_hdr, &hdr_buf);
+    if (hdr == NULL) {
+        return;
+    }
+
+    dp_tdaq_req_store(event_reqs[port_id], DP_EVENT_REQ_TABLE_SIZE,
+                      ip_hdr->src_addr, ip_hdr->dst_addr, hdr->transactionId,
+                      DP_MBUF_RX_TSC(pkt));
+}
+
+/* req is the rx tsc of the request */
+static void
+event_resp_end(void *arg, uint64_t req)
+{
+    struct event_resp *r = arg;
+
+    stats_hist_record(event_dcm_hist[r->port_id][r->flow_id], r->now - req);
+    stats_hist_record(event_ros_hist[r->port_id][r->ros_port_id], r->now - req);
+}
+
+/* follows the response stream of a ros->dcm connection, the connections
+ * of a dcm port are followed by its tx lcore only */
+static inline void
+event_resp_tx(uint8_t port_id, uint32_t flow_id, struct rte_mbuf *pkt, uint64_t now)
+{
+    struct event_resp r = {
+        .port_id = port_id,
+        .ros_port_id = pkt->port,
+        .flow_id = flow_id,
+        .now = now,
+    };
+
+    dp_tdaq_resp_follow(event_conns[port_id], DP_EVENT_CONN_TABLE_SIZE,
+                        event_reqs[pkt->port], DP_EVENT_REQ_TABLE_SIZE,
+                        pkt, event_resp_end, &r);
+}
+
+void
+dp_event_init(void)
+{
+    uint8_t i, j;
+    char s[64];
+
+    DP_LOG_ENTRY();
+
+    DAQSWITCH_PORT_FOREACH(i) {
+        snprintf(s, sizeof(s), "dp_event_reqs_p%d", i);
+        event_reqs[i] = rte_zmalloc_socket(s, DP_EVENT_REQ_TABLE_SIZE * sizeof(struct dp_tdaq_req),
+                                           CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+        RTE_VERIFY(event_reqs[i]);
+
+        snprintf(s, sizeof(s), "dp_event_conns_p%d", i);
+        event_conns[i] = rte_zmalloc_socket(s, DP_EVENT_CONN_TABLE_SIZE * sizeof(struct dp_tdaq_conn),
+                                            CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+        RTE_VERIFY(event_conns[i]);
+
+        for (j = 0; j < DP_PORT_MAX_DATA_FLOWS; j++) {
+            snprintf(s, sizeof(s), "dp_event_dcm_p%d_q%d", i, j);
+            event_dcm_hist[i][j] = rte_zmalloc_socket(s, sizeof(struct stats_hist),
+                                                      CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+            RTE_VERIFY(event_dcm_hist[i][j]);
+        }
+
+        DAQSWITCH_PORT_FOREACH(j) {
+            snprintf(s, sizeof(s), "dp_event_ros_p%d_p%d", i, j);
+            event_ros_hist[i][j] = rte_zmalloc_socket(s, sizeof(struct stats_hist),
+                                                      CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+            RTE_VERIFY(event_ros_hist[i][j]);
+        }
+    }
+
+    DP_LOG_EXIT();
+}
+
+/* called by the tx lcore of port_id for packets of voq flow_id
+ * just accepted by the nic */
+void
+dp_event_tx(uint8_t port_id, uint32_t flow_id,
+            struct rte_mbuf **pkts, uint16_t n, uint64_t now)
+{
+    uint16_t i;
+
+    if (dp.flows[port_id][flow_id].req_flow) {
+        for (i = 0; i < n; i++) {
+            event_req_tx(port_id, pkts[i]);
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            event_resp_tx(port_id, flow_id, pkts[i], now);
+        }
+    }
+}
+
+void
+dp_event_dump(void)
+{
+    struct stats_hist h;
+    uint8_t port_id, ros_port_id;
+    uint32_t i;
+    char s[32];
+
+    printf("event latency, fragment request to last response byte\n");
+    stats_hist_print_header();
+
+    /* per ros port, merged over the dcm ports */
+    DAQSWITCH_PORT_FOREACH(ros_port_id) {
+        stats_hist_reset(&h);
+        DAQSWITCH_PORT_FOREACH(port_id) {
+            stats_hist_merge(&h, event_ros_hist[port_id][ros_port_id]);
+        }
+        snprintf(s, sizeof(s), "ros port %d", ros_port_id);
+        stats_hist_print(s, &h);
+    }
+
+    stats_hist_print_footer();
+
+    /* per dcm */
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
+            if (!dp.flows[port_id][i].active || dp.flows[port_id][i].req_flow) {
+                continue;
+            }
+
+            stats_hist_reset(&h);
+            stats_hist_merge(&h, event_dcm_hist[port_id][i]);
+            snprintf(s, sizeof(s), "dcm 0x%08x", dp.flows[port_id][i].dest_ip);
+            stats_hist_print(s, &h);
+        }
+    }
+
+    stats_hist_print_footer();
+}
+
+void
+dp_event_reset(void)
+{
+    uint8_t port_id, j;
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (j = 0; j < DP_PORT_MAX_DATA_FLOWS; j++) {
+            stats_hist_reset(event_dcm_hist[port_id][j]);
+        }
+        DAQSWITCH_PORT_FOREACH(j) {
+            stats_hist_reset(event_ros_hist[port_id][j]);
+        }
+    }
+}
+
+#endif /* DP_EVENT_LATENCY */
@@ -0,0 +1,51 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_EVENT_H
+#define DP_EVENT_H
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+/* event-level latency, from a fragment request entering the switch
+ * to the last byte of the response leaving it
+ * requests are seen on the tx of request voqs, responses on the tx of
+ * the data voqs, both by the data tx lcores, so only requests and
+ * responses going over the data paths are tracked, the very first request
+ * of a data flow goes through the default pipeline and is not */
+#ifdef DP_EVENT_LATENCY
+
+#ifdef DP_LATENCY_STATS_DISABLE
+#error "DP_EVENT_LATENCY needs the rx tsc stamp of the latency stats"
+#endif
+#ifdef DAQ_DATA_FLOWS_DISABLE
+#error "DP_EVENT_LATENCY needs the data flows"
+#endif
+
+/* requests remembered per ros port, older ones are overwritten */
+#ifndef DP_EVENT_REQ_TABLE_SIZE
+    #define DP_EVENT_REQ_TABLE_SIZE                                                    4096
+#endif
+/* response tcp connections tracked per dcm port */
+#ifndef DP_EVENT_CONN_TABLE_SIZE
+    #define DP_EVENT_CONN_TABLE_SIZE                                                   4096
+#endif
+
+void dp_event_init(void);
+void dp_event_tx(uint8_t port_id, uint32_t flow_id,
+                 struct rte_mbuf **pkts, uint16_t n, uint64_t now);
+void dp_event_dump(void);
+void dp_event_reset(void);
+
+#endif /* DP_EVENT_LATENCY */
+
+#endif /* DP_EVENT_H */
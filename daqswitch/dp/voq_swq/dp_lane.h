@@ -0,0 +1,175 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_LANE_H
+#define DP_LANE_H
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+#include <rte_malloc.h>
+#include <rte_atomic.h>
+#include <rte_branch_prediction.h>
+#include <rte_debug.h>
+
+/* single-producer single-consumer ring of object pointers
+ *
+ * producer and consumer indices live in separate cache lines, each side
+ * caches the index of the other one and re-reads it only if the cached
+ * value is not enough to serve the request, so the shared lines move
+ * between cores once per burst at most
+ * indices are free-running, the slot is index & mask
+ * no atomics: on x86 stores are not reordered with other stores and
+ * loads are not reordered with other loads, only the compiler has to
+ * be kept from reordering slot accesses around index updates */
+struct dp_lane {
+    /* read-only after creation */
+    uint32_t size;
+    uint32_t mask;
+
+    /* written by the producer only */
+    struct {
+        volatile uint32_t head;
+        uint32_t tail_cache;
+    } prod __rte_cache_aligned;
+
+    /* written by the consumer only */
+    struct {
+        volatile uint32_t tail;
+        uint32_t head_cache;
+    } cons __rte_cache_aligned;
+
+    void *ring[0] __rte_cache_aligned;
+} __rte_cache_aligned;
+
+/* size must be a power of 2 */
+static inline struct dp_lane *
+dp_lane_create(const char *name, uint32_t size, int socket_id)
+{
+    struct dp_lane *l;
+
+    RTE_VERIFY(size && (size & (size - 1)) == 0);
+
+    l = rte_zmalloc_socket(name, sizeof(struct dp_lane) + size * sizeof(void *),
+                           CACHE_LINE_SIZE, socket_id);
+    if (l == NULL) {
+        return NULL;
+    }
+
+    l->size = size;
+    l->mask = size - 1;
+
+    return l;
+}
+
+/* enqueues up to n objects while keeping at most cap objects
+ * in the lane, returns the number enqueued */
+static inline unsigned
+dp_lane_enqueue_burst_cap(struct dp_lane *l, void * const *objs, unsigned n, uint32_t cap)
+{
+    uint32_t head = l->prod.head;
+    uint32_t nb_used = head - l->prod.tail_cache;
+    unsigned i;
+
+    if (unlikely(nb_used + n > cap)) {
+        l->prod.tail_cache = l->cons.tail;
+        nb_used = head - l->prod.tail_cache;
+        if (nb_used >= cap) {
+            return 0;
+        }
+        if (n > cap - nb_used) {
+            n = cap - nb_used;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        l->ring[(head + i) & l->mask] = objs[i];
+    }
+
+    /* publish the whole burst at once */
+    rte_compiler_barrier();
+    l->prod.head = head + n;
+
+    return n;
+}
+
+/* enqueues up to n objects, returns the number enqueued */
+static inline unsigned
+dp_lane_enqueue_burst(struct dp_lane *l, void * const *objs, unsigned n)
+{
+    return dp_lane_enqueue_burst_cap(l, objs, n, l->size);
+}
+
+/* dequeues up to n objects, returns the number dequeued */
+static inline unsigned
+dp_lane_dequeue_burst(struct dp_lane *l, void **objs, unsigned n)
+{
+    uint32_t tail = l->cons.tail;
+    uint32_t nb_used = l->cons.head_cache - tail;
+    unsigned i;
+
+    if (unlikely(nb_used < n)) {
+        l->cons.head_cache = l->prod.head;
+        nb_used = l->cons.head_cache - tail;
+        if (n > nb_used) {
+            n = nb_used;
+        }
+        if (n == 0) {
+            return 0;
+        }
+    }
+
+    rte_compiler_barrier();
+    for (i = 0; i < n; i++) {
+        objs[i] = l->ring[(tail + i) & l->mask];
+    }
+
+    /* release the slots */
+    rte_compiler_barrier();
+    l->cons.tail = tail + n;
+
+    return n;
+}
+
+/* first object of the lane without dequeuing it, NULL if empty */
+static inline void *
+dp_lane_peek(struct dp_lane *l)
+{
+    uint32_t tail = l->cons.tail;
+
+    if (l->cons.head_cache == tail) {
+        l->cons.head_cache = l->prod.head;
+        if (l->cons.head_cache == tail) {
+            return NULL;
+        }
+    }
+
+    rte_compiler_barrier();
+    return l->ring[tail & l->mask];
+}
+
+/* number of objects in the lane as last seen by the consumer, a lower
+ * bound which does not touch the cache line written by the producer */
+static inline unsigned
+dp_lane_count_cons(const struct dp_lane *l)
+{
+    return l->cons.head_cache - l->cons.tail;
+}
+
+/* number of objects in the lane, approximate if called
+ * by neither the producer nor the consumer */
+static inline unsigned
+dp_lane_count(const struct dp_lane *l)
+{
+    return l->prod.head - l->cons.tail;
+}
+
+#endif /* DP_LANE_H */
@@ -9,43 +9,249 @@
  *
  * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
  */
+#include <string.h>
+
 #include <rte_mbuf.h>
 #include <rte_cycles.h>
 #include <rte_ethdev.h>
-#include <rte_ring.h>
-
-#ifdef DAQ_DATA_FLOWS_DBG
+#include <rte_prefetch.h>
 #include <rte_ether.h>
 #include <rte_ip.h>
+
+#ifdef DAQ_DATA_FLOWS_DBG
 #include <rte_tcp.h>
 #endif
 
 #include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
 #include "../../stats/stats.h"
+#include "../../trace/trace.h"
+#include "../include/dp_rx_probe.h"
 
 #include "dp_voq_swq.h"
+#include "dp_tunables.h"
 
 #ifndef DAQ_DATA_FLOWS_DISABLE
+/* ecn field of the ipv4 tos byte, rfc 3168 */
+#define ECN_MASK                                                                       0x03
+#define ECN_NOT_ECT                                                                    0x00
+#define ECN_CE                                                                         0x03
+
+/* sets ce on an ecn capable packet, the header checksum is updated
+ * incrementally over the 16-bit word holding the tos, rfc 1624 eqn. 3
+ * returns 1 if the packet was marked */
+static inline unsigned
+ipv4_set_ce(struct ipv4_hdr *ip_hdr)
+{
+    uint16_t *word = (uint16_t *) ip_hdr;
+    uint16_t old_word;
+    uint32_t sum;
+
+    if ((ip_hdr->type_of_service & ECN_MASK) == ECN_NOT_ECT ||
+        (ip_hdr->type_of_service & ECN_MASK) == ECN_CE) {
+        return 0;
+    }
+
+    old_word = *word;
+    ip_hdr->type_of_service |= ECN_CE;
+
+    /* ones' complement sums do not depend on the byte order */
+    sum = (uint16_t) ~ip_hdr->hdr_checksum + (uint16_t) ~old_word + *word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    ip_hdr->hdr_checksum = (uint16_t) ~sum;
+
+    return 1;
+}
+
+/* dctcp style marking, a packet enqueued while the voq holds k packets
+ * or more is marked, the depth is read once per burst, the packet
+ * headers are touched only above the threshold */
 static inline void
-enqueue_data_pkt(struct rte_ring *ring, struct rte_mbuf **mbufs, unsigned n)
+ecn_mark(const struct dp_voq *voq, struct data_flow *flow, uint32_t k,
+         struct rte_mbuf **mbufs, unsigned n)
+{
+    const uint32_t depth = dp_voq_count(voq);
+    unsigned i, nb_marked = 0;
+
+    if (depth + n <= k) {
+        return;
+    }
+
+    for (i = depth >= k ? 0 : k - depth; i < n; i++) {
+        nb_marked += ipv4_set_ce((struct ipv4_hdr *)
+            (rte_pktmbuf_mtod(mbufs[i], uint8_t *) + sizeof(struct ether_hdr)));
+    }
+
+    if (nb_marked > 0) {
+        rte_atomic64_add(&flow->ecn_marked, nb_marked);
+    }
+}
+
+/* features of an rx round, a round is compiled for each combination with
+ * the set as a constant, so the features off leave no branches behind,
+ * the lcore picks the variant matching its tunables whenever they change,
+ * all features on is the generic round which checks the tunables itself */
+/* queues are polled on an interval, rx_poll_interval > 0 */
+#define RX_V_GATE                                                                       0x1
+/* packets are marked or tagged on enqueue, ecn_threshold > 0 or event_order */
+#define RX_V_MARK                                                                       0x2
+/* burst_rx below DP_PORT_MAX_PKT_BURST_RX */
+#define RX_V_BURST                                                                      0x4
+#define RX_V_MAX                                                                          8
+
+/* enqueues packets received on in_port_id to voq id of out_port_id */
+static inline __attribute__((always_inline)) void
+enqueue_data_pkt(const struct dp_tunables_local *tl, const unsigned v,
+                 uint8_t in_port_id, uint8_t out_port_id, uint8_t id,
+                 struct rte_mbuf **mbufs, unsigned n)
 {   
+    struct dp_lane *lane = dp.voqs[out_port_id][id].lanes[in_port_id];
+    const uint32_t cap = tl->t.voq_limit;
     unsigned n_done;
+    uint64_t stall_tsc;
+
+    if ((v & RX_V_MARK) && unlikely(tl->t.event_order)) {
+        dp_order_rx(in_port_id, out_port_id, id, mbufs, n);
+    }
 
-#ifdef DP_BACK_PRESSURE_DISABLE
-    n_done = rte_ring_enqueue_burst(ring, (void *) mbufs, n);
-    if (n_done < n) {
+    if ((v & RX_V_MARK) && tl->t.ecn_threshold > 0) {
+        ecn_mark(&dp.voqs[out_port_id][id], &dp.flows[out_port_id][id],
+                 tl->t.ecn_threshold, mbufs, n);
+    }
+
+    n_done = dp_lane_enqueue_burst_cap(lane, (void *) mbufs, n, cap);
+    if (likely(n_done == n)) {
+        return;
+    }
+
+    if (!tl->t.back_pressure) {
+        TRACE(VOQ_FULL, out_port_id, id, n - n_done);
         do {
             rte_pktmbuf_free(mbufs[n_done]);
         } while (++n_done < n);
+        return;
     }
-#else
+
+    /* voq full, wait for room and account the stall to the flow */
+    TRACE(STALL_BEGIN, out_port_id, id, in_port_id);
+    stall_tsc = rte_rdtsc();
+    mbufs += n_done;
+    n -= n_done;
+
     while (n > 0) {
-        n_done = rte_ring_enqueue_burst(ring, (void *) mbufs, n);
+        n_done = dp_lane_enqueue_burst_cap(lane, (void *) mbufs, n, cap);
         mbufs += n_done;
         n -= n_done;
     }
+
+    stall_tsc = rte_rdtsc() - stall_tsc;
+    rte_atomic64_add(&dp.flows[out_port_id][id].stall_cycles, stall_tsc);
+    TRACE(STALL_END, out_port_id, id, stall_tsc > UINT32_MAX ? UINT32_MAX : stall_tsc);
+
+}
+
+/* poll gate of an rx queue
+ * a full burst means a backlog, the queue is then polled back to back,
+ * a burst filled by half or more halves the interval, a sparser one grows
+ * it by a step and an empty poll doubles it, always bounded by the
+ * rx_poll_interval tunable, the latency budget of a waiting packet
+ * with the controller off the interval is the budget unless the burst
+ * was full */
+struct rx_poll_ctl {
+    uint64_t next_tsc;
+    uint64_t interval_tsc;
+};
+
+static inline void
+rx_poll_update(struct rx_poll_ctl *c, const struct dp_tunables_local *tl,
+               uint32_t nb_rx, uint64_t now)
+{
+    if (nb_rx == tl->t.burst_rx) {
+        c->interval_tsc = 0;
+    } else if (!tl->t.rx_poll_adaptive) {
+        c->interval_tsc = tl->rx_poll_tsc;
+    } else if (nb_rx > 0 && nb_rx * 2 >= tl->t.burst_rx) {
+        c->interval_tsc >>= 1;
+    } else if (nb_rx > 0) {
+        c->interval_tsc += tl->rx_poll_step_tsc;
+    } else {
+        c->interval_tsc = (c->interval_tsc << 1) + tl->rx_poll_step_tsc;
+    }
+
+    if (c->interval_tsc > tl->rx_poll_tsc) {
+        c->interval_tsc = tl->rx_poll_tsc;
+    }
+    c->next_tsc = now + c->interval_tsc;
+}
+
+/* scratch space for bucketing a burst by destination voq */
+struct voq_sort {
+    uint8_t count[DP_PORT_MAX_DATA_FLOWS];
+    uint8_t offset[DP_PORT_MAX_DATA_FLOWS];
+    uint8_t used[DP_PORT_MAX_PKT_BURST_RX];
+    uint8_t voq[DP_PORT_MAX_PKT_BURST_RX];
+    struct rte_mbuf *sorted[DP_PORT_MAX_PKT_BURST_RX];
+};
+
+/* enqueues a burst received on in_port_id to the voqs of out_port_id
+ * with a single bulk enqueue per voq, packets are bucketed with a stable
+ * counting sort, so the order within a flow is kept
+ * vs->count must be all zeros on entry and is left so */
+static inline __attribute__((always_inline)) void
+enqueue_data_burst(const struct dp_tunables_local *tl, const unsigned v, struct voq_sort *vs,
+                   uint8_t in_port_id, uint8_t out_port_id,
+                   struct rte_mbuf **pkts, uint32_t n)
+{
+    uint32_t i, nb_used = 0, pos = 0;
+    uint8_t id;
+#ifndef DP_LATENCY_STATS_DISABLE
+    const uint64_t rx_tsc = rte_rdtsc();
 #endif
 
+    /* count packets per voq, prefetching mbufs ahead */
+    for (i = 0; i < n; i++) {
+        if (i + DP_PORT_RX_PREFETCH_OFFSET < n) {
+            rte_prefetch0(pkts[i + DP_PORT_RX_PREFETCH_OFFSET]);
+#ifndef DP_LATENCY_STATS_DISABLE
+            rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(pkts[i + DP_PORT_RX_PREFETCH_OFFSET], 0));
+#endif
+        }
+
+#ifndef DP_LATENCY_STATS_DISABLE
+        DP_MBUF_RX_TSC(pkts[i]) = rx_tsc;
+#endif
+        id = pkts[i]->hash.fdir.id & DP_FDIR_OUT_QUEUE_MASK;
+        vs->voq[i] = id;
+        if (vs->count[id]++ == 0) {
+            vs->used[nb_used++] = id;
+        }
+    }
+
+    /* single destination, nothing to sort */
+    if (nb_used == 1) {
+        vs->count[vs->used[0]] = 0;
+        enqueue_data_pkt(tl, v, in_port_id, out_port_id, vs->used[0], pkts, n);
+        return;
+    }
+
+    for (i = 0; i < nb_used; i++) {
+        vs->offset[vs->used[i]] = pos;
+        pos += vs->count[vs->used[i]];
+    }
+
+    for (i = 0; i < n; i++) {
+        vs->sorted[vs->offset[vs->voq[i]]++] = pkts[i];
+    }
+
+    /* offset now points past the bucket */
+    for (i = 0; i < nb_used; i++) {
+        id = vs->used[i];
+        enqueue_data_pkt(tl, v, in_port_id, out_port_id, id,
+                         &vs->sorted[vs->offset[id] - vs->count[id]],
+                         vs->count[id]);
+        vs->count[id] = 0;
+    }
 }
 
 void
@@ -58,87 +264,227 @@ dp_configure_lcore_data_rx(__attribute__((unused)) struct dp_lcore_params *lp)
 
 }
 
-void
-dp_main_loop_lcore_data_rx(__attribute__((unused)) struct dp_lcore_params *lp)
+/* serves a request posted by the balancer, an rx port is never split */
+static void
+rx_mbox_handle(struct dp_lcore_params *lp)
 {
-    struct rte_mbuf *pkts_burst[DP_PORT_MAX_PKT_BURST_RX];
-    struct rte_mbuf **pkt_enq;
-    struct lcore_data_rx_port_conf *cur_rxp;
-    struct data_rx_queue *cur_rxq;
-    struct rte_ring *out_ring;
-    uint32_t nb_rx;
-    uint32_t nb_enq;
-    uint32_t fdir_id;
-
-    RTE_VERIFY(lp);
-    RTE_VERIFY(lp->type == DP_LCORE_TYPE_DATA_RX);
+    struct dp_lcore_mbox *mbox = &lp->mbox;
+    uint32_t cmd = mbox->cmd;
+    uint8_t port_idx;
+    int ret = DP_SUCCESS;
 
-    if (lp->nb_ports == 0) {
-        DP_LOG_INFO("lcore %u has nothing to do", lp->id);
+    /* lost to the balancer withdrawing it */
+    if (!rte_atomic32_cmpset(&mbox->cmd, cmd, DP_MBOX_BUSY)) {
         return;
     }
 
-#if DP_RX_POLL_INTERVAL
-    const uint64_t poll_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * DP_RX_POLL_INTERVAL;
-    uint64_t last_poll_tsc[DP_LCORE_PORT_MAX][DP_PORT_RXQ_MAX];
-    uint64_t diff_tsc;
-#endif
+    for (port_idx = 0; port_idx < lp->nb_ports; port_idx++) {
+        if (lp->rx.port_list[port_idx].port_id == mbox->port_id) {
+            break;
+        }
+    }
 
-    uint64_t i;
-    uint8_t port_idx = 0;
+    switch (cmd) {
+    case DP_MBOX_RELEASE:
+        RTE_VERIFY(port_idx < lp->nb_ports);
+        /* keep the list dense */
+        lp->rx.port_list[port_idx] = lp->rx.port_list[--lp->nb_ports];
+        break;
 
-    while (1) {
+    case DP_MBOX_ADOPT:
+        if (port_idx < lp->nb_ports) {
+            break;
+        }
+        RTE_VERIFY(lp->nb_ports < DP_LCORE_PORT_MAX);
+        dp_rx_port_conf_init(&lp->rx.port_list[lp->nb_ports], mbox->port_id);
+        lp->nb_ports++;
+        break;
 
-        port_idx %= lp->nb_ports;
-        cur_rxp = &lp->rx.port_list[port_idx]; 
+    default:
+        DP_LOG_ERR("lcore %u: unknown mbox command %u", lp->id, cmd);
+        ret = DP_ERR;
+        break;
+    }
 
-        for (i = 0; i < cur_rxp->nb_queues; i++) {
+    mbox->ret = ret;
+    rte_compiler_barrier();
+    mbox->cmd = DP_MBOX_NONE;
+}
+
+/* state of an rx lcore, indexed by port id as ports move between lcores */
+struct rx_state {
+    struct rte_mbuf *pkts_burst[DP_PORT_MAX_PKT_BURST_RX];
+    struct voq_sort vs;
+    struct rx_poll_ctl poll_ctl[DAQSWITCH_MAX_PORTS][DP_PORT_RXQ_MAX];
+    /* queues known to hold packets, they skip the probe */
+    uint64_t active[DAQSWITCH_MAX_PORTS];
+    bool probe[DAQSWITCH_MAX_PORTS];
+};
+
+/* polls the data queues of a port once,
+ * returns the number of packets received */
+static inline __attribute__((always_inline)) uint32_t
+rx_port_round(struct rx_state *st, struct lcore_data_rx_port_conf *cur_rxp,
+              const struct dp_tunables_local *tl, const unsigned v)
+{
+    const uint8_t port_id = cur_rxp->port_id;
+    const uint32_t burst = (v & RX_V_BURST) ? tl->t.burst_rx : DP_PORT_MAX_PKT_BURST_RX;
+    struct data_rx_queue *cur_rxq;
+    struct rx_poll_ctl *ctl;
+    uint64_t now = 0;
+    uint32_t nb_rx, work = 0;
+    uint64_t i;
 
-            cur_rxq = &cur_rxp->queue_list[i];
+    for (i = 0; i < cur_rxp->nb_queues; i++) {
 
-#if DP_RX_POLL_INTERVAL
-            diff_tsc = rte_rdtsc() - last_poll_tsc[port_idx][i];
+        cur_rxq = &cur_rxp->queue_list[i];
 
-            if (diff_tsc < poll_tsc) {
+        /* without an interval every queue is polled every round */
+        ctl = &st->poll_ctl[port_id][i];
+        if (v & RX_V_GATE) {
+            now = rte_rdtsc();
+            if (now < ctl->next_tsc) {
                 continue;
             }
+        }
+
+        /* an idle queue is probed before running the rx burst */
+        if (st->probe[port_id] && !(st->active[port_id] & (1ULL << i)) &&
+            dp_rx_probe(port_id, cur_rxq->queue_id) == 0) {
+            if (v & RX_V_GATE) {
+                rx_poll_update(ctl, tl, 0, now);
+            }
+            continue;
+        }
+
+        nb_rx = rte_eth_rx_burst(port_id, cur_rxq->queue_id,
+                                 st->pkts_burst, burst);
+        if (v & RX_V_GATE) {
+            rx_poll_update(ctl, tl, nb_rx, now);
+        }
+
+        /* a full burst leaves packets behind */
+        if (nb_rx == burst) {
+            st->active[port_id] |= 1ULL << i;
+        } else {
+            st->active[port_id] &= ~(1ULL << i);
+        }
+
+        if (nb_rx > 0) {
+
+            daqswitch_rx_queue_stats[port_id][cur_rxq->queue_id].total_packets += nb_rx;
+            daqswitch_rx_queue_stats[port_id][cur_rxq->queue_id].total_bursts++;
+
+            enqueue_data_burst(tl, v, &st->vs, port_id, cur_rxq->out_port_id,
+                               st->pkts_burst, nb_rx);
+            work += nb_rx;
+
+        }
+    }
+
+    return work;
+}
+
+typedef uint32_t (*rx_round_t)(struct rx_state *st, struct lcore_data_rx_port_conf *cur_rxp,
+                               const struct dp_tunables_local *tl);
+
+#define RX_ROUND(v)                                                                         \
+static uint32_t                                                                             \
+rx_port_round_##v(struct rx_state *st, struct lcore_data_rx_port_conf *cur_rxp,             \
+                  const struct dp_tunables_local *tl)                                       \
+{                                                                                           \
+    return rx_port_round(st, cur_rxp, tl, v);                                               \
+}
+RX_ROUND(0) RX_ROUND(1) RX_ROUND(2) RX_ROUND(3)
+RX_ROUND(4) RX_ROUND(5) RX_ROUND(6) RX_ROUND(7)
+
+static const rx_round_t rx_rounds[RX_V_MAX] = {
+    rx_port_round_0, rx_port_round_1, rx_port_round_2, rx_port_round_3,
+    rx_port_round_4, rx_port_round_5, rx_port_round_6, rx_port_round_7,
+};
+
+/* variant of the rx round for the tunables of the lcore */
+static unsigned
+rx_variant(const struct dp_tunables_local *tl)
+{
+    unsigned v = 0;
+
+#ifdef DP_LOOP_VARIANTS_DISABLE
+    v = RX_V_MAX - 1;
+#else
+    if (tl->t.rx_poll_interval > 0) {
+        v |= RX_V_GATE;
+    }
+    if (tl->t.ecn_threshold > 0 || tl->t.event_order) {
+        v |= RX_V_MARK;
+    }
+    if (tl->t.burst_rx != DP_PORT_MAX_PKT_BURST_RX) {
+        v |= RX_V_BURST;
+    }
 #endif
 
-            nb_rx = rte_eth_rx_burst(cur_rxp->port_id, cur_rxq->queue_id,
-                                     pkts_burst, DP_PORT_MAX_PKT_BURST_RX);
+    return v;
+}
 
-            if (nb_rx > 0) {
+void
+dp_main_loop_lcore_data_rx(__attribute__((unused)) struct dp_lcore_params *lp)
+{
+    struct lcore_data_rx_port_conf *cur_rxp;
+    struct dp_tunables_local tl;
+    struct rx_state st;
+    rx_round_t rx_round;
+    uint64_t now, round_tsc;
+    uint32_t work;
+    uint8_t port_idx = 0;
+#ifndef DP_RX_PROBE_DISABLE
+    uint8_t port_id;
+#endif
 
-                daqswitch_rx_queue_stats[cur_rxp->port_id][cur_rxq->queue_id].total_packets += nb_rx;
-                daqswitch_rx_queue_stats[cur_rxp->port_id][cur_rxq->queue_id].total_bursts++;
+    RTE_VERIFY(lp);
+    RTE_VERIFY(lp->type == DP_LCORE_TYPE_DATA_RX);
+
+    if (lp->nb_ports == 0) {
+        DP_LOG_INFO("lcore %u is idle until the balancer gives it a port", lp->id);
+    }
 
-#if DP_RX_POLL_INTERVAL
-                /* repeat if queue is filling up */
-                if (nb_rx < DP_PORT_MAX_PKT_BURST_RX) {
-                    last_poll_tsc[port_idx][i] = rte_rdtsc();
-                }
+    RTE_BUILD_BUG_ON(DP_PORT_RXQ_MAX > 64);
+
+    memset(&st, 0, sizeof(st));
+#ifndef DP_RX_PROBE_DISABLE
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        st.probe[port_id] = dp_rx_probe_supported(port_id);
+    }
 #endif
 
-                pkt_enq = pkts_burst;
+    dp_tunables_local_init(&tl);
+    rx_round = rx_rounds[rx_variant(&tl)];
 
-                while (nb_rx > 0) {
-                    fdir_id = (*pkt_enq)->hash.fdir.id & DP_FDIR_OUT_QUEUE_MASK;
-                    out_ring = dp.rings[cur_rxq->out_port_id][fdir_id];
-                    nb_enq = 1;
+    while (1) {
 
-                    while (nb_enq < nb_rx) {
-                        if (((*(pkt_enq + nb_enq))->hash.fdir.id & DP_FDIR_OUT_QUEUE_MASK) != fdir_id) {
-                            break;
-                        }
-                        ++nb_enq;
-                    }
+        if (unlikely(lp->mbox.cmd != DP_MBOX_NONE)) {
+            rx_mbox_handle(lp);
+        }
 
-                    enqueue_data_pkt(out_ring, pkt_enq, nb_enq);
-                    pkt_enq += nb_enq;
-                    nb_rx -= nb_enq;
-                }
+        if (unlikely(lp->nb_ports == 0)) {
+            continue;
+        }
 
-            }
+        port_idx %= lp->nb_ports;
+        cur_rxp = &lp->rx.port_list[port_idx]; 
+        round_tsc = rte_rdtsc();
+
+        if (unlikely(dp_tunables_refresh(&tl))) {
+            rx_round = rx_rounds[rx_variant(&tl)];
+        }
+
+        work = rx_round(&st, cur_rxp, &tl);
+
+        /* load seen by the balancer */
+        now = rte_rdtsc();
+        lp->load.total_tsc += now - round_tsc;
+        if (work > 0) {
+            lp->load.busy_tsc += now - round_tsc;
+            cur_rxp->busy_tsc += now - round_tsc;
         }
         
         port_idx++;
@@ -9,18 +9,333 @@
  *
  * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
  */
+#include <string.h>
+
 #include <rte_mbuf.h>
 #include <rte_ethdev.h>
-#include <rte_ring.h>
 #include <rte_cycles.h>
+#include <rte_prefetch.h>
 
 #include "../../common/common.h"
 #include "../../stats/stats.h"
+#include "../../trace/trace.h"
+#include "../../pipeline/pipeline.h"
 
 #include "dp_voq_swq.h"
+#include "dp_tdaq.h"
+#include "dp_tunables.h"
+#include "dp_event.h"
+#include "dp_tcpmon.h"
+#include "dp_admit.h"
+#include "dp_sched.h"
 #include "../../common/common.h"
 
 #ifndef DAQ_DATA_FLOWS_DISABLE
+/* merges the lanes of a voq into a single burst,
+ * starting with the lane following the last one served */
+static inline uint32_t
+voq_dequeue_burst(struct dp_voq *voq, struct rte_mbuf **pkts, uint32_t n)
+{
+    uint32_t nb_deq = 0;
+    uint8_t i, lane;
+
+    for (i = 0; i < voq->nb_lanes && nb_deq < n; i++) {
+        lane = voq->lane_next;
+        voq->lane_next = (lane + 1 == voq->nb_lanes) ? 0 : lane + 1;
+
+        nb_deq += dp_lane_dequeue_burst(voq->lanes[lane],
+                                        (void **) &pkts[nb_deq],
+                                        n - nb_deq);
+    }
+
+    return nb_deq;
+}
+
+/* backlog of a voq as seen by the consumer, a lower bound */
+static inline uint32_t
+voq_backlog(struct dp_voq *voq)
+{
+    uint32_t count = 0;
+    uint8_t i;
+
+    for (i = 0; i < voq->nb_lanes; i++) {
+        count += dp_lane_count_cons(voq->lanes[i]);
+    }
+
+    return count;
+}
+
+/* first fragment request of a lane under admission control, the lane is
+ * not served past a request of a dcm at its budget, unless the request
+ * has waited adm_hold_max already */
+static inline int
+adm_admit(struct dp_voq *voq, uint8_t port_id, uint8_t lane, struct rte_mbuf *m,
+          const struct dp_tunables_local *tl)
+{
+    struct ipv4_hdr *ip_hdr;
+    struct tdaq_hdr hdr_buf;
+    struct dp_adm_dcm *dcm;
+    uint64_t now;
+    uint16_t slot;
+
+    /* acks and other segments are never held */
+    if (dp_tdaq_req_hdr(m, &ip_hdr, &hdr_buf) == NULL) {
+        return 1;
+    }
+
+    slot = dp_adm_lookup(ip_hdr->src_addr);
+    if (slot == DP_ADM_SLOT_NONE) {
+        return 1;
+    }
+    dcm = &dp_adm[slot];
+
+    if (dp_adm_charge(dcm, (int64_t) tl->t.adm_budget * 1024, tl->t.adm_fragment_size, 0)) {
+        voq->adm_hold_tsc[lane] = 0;
+        return 1;
+    }
+
+    now = rte_rdtsc();
+    if (voq->adm_hold_tsc[lane] == 0) {
+        voq->adm_hold_tsc[lane] = now;
+        rte_atomic64_inc(&dcm->held);
+        TRACE(ADM_HOLD, port_id, lane, rte_be_to_cpu_32(dcm->ip));
+    }
+
+    if (now - voq->adm_hold_tsc[lane] < tl->adm_hold_tsc) {
+        return 0;
+    }
+
+    dp_adm_charge(dcm, 0, tl->t.adm_fragment_size, 1);
+    rte_atomic64_inc(&dcm->expired);
+    voq->adm_hold_tsc[lane] = 0;
+
+    return 1;
+}
+
+/* voq_dequeue_burst of a request voq under admission control, packet by
+ * packet as each request may stop its lane */
+static inline uint32_t
+adm_dequeue_burst(struct dp_voq *voq, uint8_t port_id, struct rte_mbuf **pkts, uint32_t n,
+                  const struct dp_tunables_local *tl)
+{
+    struct rte_mbuf *m;
+    uint32_t nb_deq = 0;
+    uint8_t i, lane;
+
+    for (i = 0; i < voq->nb_lanes && nb_deq < n; i++) {
+        lane = voq->lane_next;
+        voq->lane_next = (lane + 1 == voq->nb_lanes) ? 0 : lane + 1;
+
+        while (nb_deq < n && (m = dp_lane_peek(voq->lanes[lane])) != NULL &&
+               adm_admit(voq, port_id, lane, m, tl)) {
+            nb_deq += dp_lane_dequeue_burst(voq->lanes[lane], (void **) &pkts[nb_deq], 1);
+        }
+    }
+
+    return nb_deq;
+}
+
+/* voq_dequeue_burst of a data voq under event ordering, takes the run of
+ * packets of the oldest event at the head of a lane, then looks again */
+static inline uint32_t
+order_dequeue_burst(struct dp_voq *voq, struct rte_mbuf **pkts, uint32_t n)
+{
+    struct rte_mbuf *m;
+    uint64_t tag, oldest;
+    uint32_t nb_deq = 0;
+    uint8_t i, lane;
+
+    while (nb_deq < n) {
+        lane = voq->nb_lanes;
+        oldest = DP_EVENT_UNTAGGED;
+
+        for (i = 0; i < voq->nb_lanes; i++) {
+            m = dp_lane_peek(voq->lanes[i]);
+            if (m == NULL) {
+                continue;
+            }
+            tag = DP_MBUF_EVENT(m);
+            if (lane == voq->nb_lanes || dp_event_older(tag, oldest)) {
+                lane = i;
+                oldest = tag;
+            }
+        }
+        if (lane == voq->nb_lanes) {
+            break;
+        }
+
+        do {
+            nb_deq += dp_lane_dequeue_burst(voq->lanes[lane], (void **) &pkts[nb_deq], 1);
+        } while (nb_deq < n && (m = dp_lane_peek(voq->lanes[lane])) != NULL &&
+                 DP_MBUF_EVENT(m) == oldest);
+    }
+
+    return nb_deq;
+}
+
+/* flow record counters of packets just accepted by the nic,
+ * returns their bytes */
+static inline uint64_t
+flow_account(struct data_flow *flow, struct rte_mbuf **pkts, uint16_t n, uint64_t now)
+{
+    uint64_t bytes = 0;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        bytes += rte_pktmbuf_pkt_len(pkts[i]);
+    }
+
+    if (unlikely(flow->start_tsc == 0)) {
+        flow->start_tsc = now;
+    }
+    flow->end_tsc = now;
+    flow->packets += n;
+    flow->bytes += bytes;
+
+    return bytes;
+}
+
+/* consecutive packets of a burst taken from the same voq */
+struct tx_run {
+    uint32_t flow_id;
+    uint16_t n;
+    /* dcm credited with the packets under admission control */
+    uint16_t adm_slot;
+};
+
+/* packets accepted from the voqs, but not yet by the nic
+ * a burst is gathered from several voqs of a port, so lightly loaded
+ * voqs share the descriptor writes and the doorbell of one tx burst,
+ * the packets of each voq stay in order, runs tell which voq they
+ * come from, more packets are added only while nothing is pending */
+struct tx_pending {
+    struct rte_mbuf *pkts[DP_PORT_MAX_PKT_BURST_TX];
+    uint16_t head;
+    uint16_t n;
+    struct tx_run runs[DP_PORT_MAX_PKT_BURST_TX];
+    uint16_t run_head;
+    uint16_t nb_runs;
+};
+
+/* accounts n packets just added at the end of the pending ones */
+static inline void
+tx_pending_add(struct tx_pending *txp, uint32_t flow_id, uint16_t adm_slot, uint16_t n)
+{
+    struct tx_run *run = NULL;
+
+    if (txp->nb_runs > 0) {
+        run = &txp->runs[txp->run_head + txp->nb_runs - 1];
+    }
+    if (run == NULL || run->flow_id != flow_id) {
+        run = &txp->runs[txp->run_head + txp->nb_runs++];
+        run->flow_id = flow_id;
+        run->n = 0;
+        run->adm_slot = adm_slot;
+    }
+
+    run->n += n;
+    txp->n += n;
+}
+
+#ifndef DP_LATENCY_STATS_DISABLE
+/* records the sojourn time of packets just accepted by the nic,
+ * they are freed by the pmd on a later tx burst on the same queue only,
+ * which is issued by this lcore */
+static inline void
+sojourn_record(struct stats_hist *voq_hist, struct stats_hist *port_hist,
+               struct rte_mbuf **pkts, uint16_t n, uint64_t now)
+{
+    uint64_t sojourn;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        sojourn = now - DP_MBUF_RX_TSC(pkts[i]);
+        stats_hist_record(voq_hist, sojourn);
+        stats_hist_record(port_hist, sojourn);
+    }
+}
+#endif
+
+/* accounts packets of a run just accepted by the nic */
+static inline void
+tx_account(const struct tx_run *run, uint8_t port_id, uint16_t queue_id,
+           struct rte_mbuf **pkts, uint16_t n, uint64_t now)
+{
+    uint64_t bytes;
+
+    bytes = flow_account(&dp.flows[port_id][run->flow_id], pkts, n, now);
+    if (run->adm_slot != DP_ADM_SLOT_NONE) {
+        dp_adm_credit(run->adm_slot, bytes);
+    }
+#ifndef DP_LATENCY_STATS_DISABLE
+    sojourn_record(dp.voqs[port_id][run->flow_id].sojourn, dp.port_sojourn[port_id][queue_id],
+                   pkts, n, now);
+#endif
+#ifdef DP_EVENT_LATENCY
+    dp_event_tx(port_id, run->flow_id, pkts, n, now);
+#endif
+#ifdef DP_TCP_MONITOR
+    dp_tcpmon_tx(port_id, run->flow_id, pkts, n);
+#endif
+}
+
+/* single tx attempt of the pending packets,
+ * returns the number of packets still pending */
+static inline uint16_t
+tx_pending_flush(struct tx_pending *txp, uint8_t port_id, uint16_t queue_id)
+{
+    uint16_t nb_tx;
+
+    if (txp->n == 0) {
+        return 0;
+    }
+
+    nb_tx = rte_eth_tx_burst(port_id, queue_id, &txp->pkts[txp->head], txp->n);
+    daqswitch_tx_queue_stats[port_id][queue_id].total_bursts++;
+
+    if (nb_tx > 0) {
+        const uint64_t now = rte_rdtsc();
+        struct rte_mbuf **pkts = &txp->pkts[txp->head];
+        struct tx_run *run;
+        uint16_t left = nb_tx, k;
+
+        /* the packets sent cover the first runs, the last one maybe in part */
+        while (left > 0) {
+            run = &txp->runs[txp->run_head];
+            k = RTE_MIN(left, run->n);
+            tx_account(run, port_id, queue_id, pkts, k, now);
+            pkts += k;
+            left -= k;
+            run->n -= k;
+            if (run->n == 0) {
+                txp->run_head++;
+                txp->nb_runs--;
+            }
+        }
+    }
+
+    txp->head += nb_tx;
+    txp->n -= nb_tx;
+    if (txp->n == 0) {
+        txp->head = 0;
+        txp->run_head = 0;
+    }
+
+    return txp->n;
+}
+
+/* sends the gathered burst, returns true if the nic did not take all of it */
+static inline bool
+tx_pending_send(struct tx_pending *txp, uint8_t port_id, uint16_t queue_id)
+{
+    if (tx_pending_flush(txp, port_id, queue_id) == 0) {
+        return false;
+    }
+
+    TRACE(TXQ_FULL, port_id, queue_id, txp->n);
+    return true;
+}
+
 void
 dp_configure_lcore_data_tx(__attribute__((unused)) struct dp_lcore_params *lp)
 {
@@ -31,90 +346,491 @@ dp_configure_lcore_data_tx(__attribute__((unused)) struct dp_lcore_params *lp)
 
 }
 
-void
-dp_main_loop_lcore_data_tx(__attribute__((unused)) struct dp_lcore_params *lp)
+#ifdef DP_EGRESS_SCHED
+/* moves the voq lanes into the scheduler as far as its queues have room,
+ * returns the number of packets moved */
+static inline uint32_t
+sched_feed(struct dp_sched *s, uint8_t port_id, uint64_t flows, uint32_t burst)
 {
-    struct rte_ring *in_ring;
-    struct rte_mbuf *pkts_burst[DP_PORT_MAX_PKT_BURST_TX];
-    struct rte_mbuf **pkts_tx;
-    struct lcore_data_tx_port_conf *cur_txp;
-    uint32_t nb_tx, nb_deq;
-    uint16_t queue_id;
-    
-    RTE_VERIFY(lp);
-    RTE_VERIFY(lp->type == DP_LCORE_TYPE_DATA_TX);
+    struct rte_mbuf *pkts[DP_PORT_MAX_PKT_BURST_TX];
+    struct dp_voq *voq;
+    uint32_t i, slot, room, n, nb_enq, work = 0;
+    uint8_t lane, tc;
+    unsigned j;
 
-    if (lp->nb_ports == 0) {
-        DP_LOG_INFO("lcore %u has nothing to do", lp->id);
-        return;
+    for (; flows; flows &= flows - 1) {
+        i = __builtin_ctzll(flows);
+        voq = &dp.voqs[port_id][i];
+        tc = dp.flows[port_id][i].tc;
+
+        for (lane = 0; lane < voq->nb_lanes; lane++) {
+            slot = DP_SCHED_SLOT(DP_SCHED_SUBPORT(lane), DP_SCHED_QUEUE(lane));
+            room = DP_SCHED_QSIZE - s->queued[slot][i];
+
+            n = dp_lane_dequeue_burst(voq->lanes[lane], (void **) pkts, RTE_MIN(room, burst));
+            if (n == 0) {
+                continue;
+            }
+
+            for (j = 0; j < n; j++) {
+                rte_sched_port_pkt_write(pkts[j], DP_SCHED_SUBPORT(lane), i, tc,
+                                         DP_SCHED_QUEUE(lane), e_RTE_METER_GREEN);
+            }
+
+            /* all of them go to the same queue, red frees the dropped ones */
+            nb_enq = rte_sched_port_enqueue(s->port, pkts, n);
+            s->queued[slot][i] += nb_enq;
+            s->nb_queued += nb_enq;
+            s->dropped += n - nb_enq;
+            work += n;
+        }
+    }
+
+    return work;
+}
+
+/* a burst picked by the scheduler to the tx queue,
+ * the pending buffer of the queue must be empty,
+ * returns the number of packets taken from the scheduler */
+static inline uint32_t
+sched_tx(struct dp_sched *s, struct tx_pending *txp, uint8_t port_id,
+         uint16_t queue_id, uint32_t burst, bool *blocked)
+{
+    uint32_t subport, pipe, tc, queue;
+    int nb_deq, j;
+
+    if (s->nb_queued == 0) {
+        return 0;
     }
 
-#if DP_TX_DRAIN_INTERVAL
-    const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * DP_TX_DRAIN_INTERVAL;
-    uint64_t last_drain_tsc[DP_LCORE_PORT_MAX][DP_PORT_MAX_DATA_FLOWS];
-    uint64_t diff_tsc;
+    nb_deq = rte_sched_port_dequeue(s->port, txp->pkts, burst);
+    if (nb_deq <= 0) {
+        return 0;
+    }
+
+    /* the scheduler mixes the voqs (pipes) in a burst */
+    for (j = 0; j < nb_deq; j++) {
+        rte_sched_port_pkt_read_tree_path(txp->pkts[j], &subport, &pipe, &tc, &queue);
+        s->queued[DP_SCHED_SLOT(subport, queue)][pipe]--;
+        tx_pending_add(txp, pipe, DP_ADM_SLOT_NONE, 1);
+#ifndef DP_LATENCY_STATS_DISABLE
+        rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(txp->pkts[j], 0));
 #endif
-    uint64_t i;
-    uint8_t port_idx = 0;
+    }
+    s->nb_queued -= nb_deq;
 
-    while (1) {
+    daqswitch_tx_queue_stats[port_id][queue_id].total_packets += nb_deq;
+    *blocked = tx_pending_send(txp, port_id, queue_id);
 
-        port_idx %= lp->nb_ports;
-        cur_txp = &lp->tx.port_list[port_idx]; 
+    return nb_deq;
+}
+#endif
 
-        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
+/* sends everything pending on the class queues of a port (part),
+ * used on a port hand-over, gives up after DP_MBOX_DRAIN_TIMEOUT, so a
+ * nic queue not taking packets (link down, pause frames) does not stop
+ * the other ports of the lcore */
+static int
+tx_pending_drain(struct tx_pending pending[], uint8_t port_id, uint16_t queue_base)
+{
+    const uint64_t deadline = rte_rdtsc() + rte_get_tsc_hz() / 1000 * DP_MBOX_DRAIN_TIMEOUT;
+    uint8_t tc;
+#ifdef DP_EGRESS_SCHED
+    struct dp_sched *s = dp_sched_get(port_id, queue_base);
+    bool blocked;
+#endif
 
-            if ( !(cur_txp->active_flows & (1 << i)) ) {
-                continue;
+    for (tc = 0; tc < DP_TC_MAX; tc++) {
+        while (tx_pending_flush(&pending[queue_base + tc], port_id, queue_base + tc) > 0) {
+            if (rte_rdtsc() > deadline) {
+                return DP_ERR;
             }
+        }
+    }
 
-            in_ring = dp.rings[cur_txp->port_id][i];
+#ifdef DP_EGRESS_SCHED
+    /* packets of the voqs handed over must not be overtaken,
+     * the scheduler may keep to its rates for a while */
+    while (s->nb_queued > 0) {
+        sched_tx(s, &pending[queue_base], port_id, queue_base, DP_PORT_MAX_PKT_BURST_TX, &blocked);
+        while (tx_pending_flush(&pending[queue_base], port_id, queue_base) > 0) {
+            if (rte_rdtsc() > deadline) {
+                return DP_ERR;
+            }
+        }
+        if (rte_rdtsc() > deadline) {
+            return DP_ERR;
+        }
+    }
+#endif
 
-#if DP_TX_DRAIN_INTERVAL
-            diff_tsc = rte_rdtsc() - last_drain_tsc[port_idx][i];
+    return DP_SUCCESS;
+}
 
-            if (dp.flows[cur_txp->port_id][i].req_flow || diff_tsc > drain_tsc) {
-#endif
+/* serves a request posted by the balancer */
+static void
+tx_mbox_handle(struct dp_lcore_params *lp,
+               struct tx_pending pending[][DP_PORT_TXQ_MAX])
+{
+    struct dp_lcore_mbox *mbox = &lp->mbox;
+    struct lcore_data_tx_port_conf *conf = NULL;
+    uint32_t cmd = mbox->cmd;
+    uint8_t port_idx;
+    int ret = DP_SUCCESS;
 
-                nb_deq = rte_ring_dequeue_burst(in_ring,
-                                                (void **) pkts_burst,
-                                                DP_PORT_MAX_PKT_BURST_TX);
+    /* lost to the balancer withdrawing it */
+    if (!rte_atomic32_cmpset(&mbox->cmd, cmd, DP_MBOX_BUSY)) {
+        return;
+    }
 
-                if (nb_deq > 0) {
+    for (port_idx = 0; port_idx < lp->nb_ports; port_idx++) {
+        if (lp->tx.port_list[port_idx].port_id == mbox->port_id) {
+            conf = &lp->tx.port_list[port_idx];
+            break;
+        }
+    }
 
-                    queue_id = dp.flows[cur_txp->port_id][i].req_flow ? DP_PORT_TXQ_ID_REQ : DP_PORT_TXQ_ID_DATA;
-                    daqswitch_tx_queue_stats[cur_txp->port_id][queue_id].total_packets += nb_deq;
-                    pkts_tx = pkts_burst;
+    switch (cmd) {
+    case DP_MBOX_RELEASE:
+        RTE_VERIFY(conf);
+        ret = tx_pending_drain(pending[conf->port_id], conf->port_id, conf->queue_base);
+        if (ret != DP_SUCCESS) {
+            break;
+        }
+        /* keep the list dense */
+        *conf = lp->tx.port_list[--lp->nb_ports];
+        break;
 
-                    while (1) {
+    case DP_MBOX_SET_MASK:
+        RTE_VERIFY(conf);
+        ret = tx_pending_drain(pending[conf->port_id], conf->port_id, conf->queue_base);
+        if (ret != DP_SUCCESS) {
+            break;
+        }
+        conf->voq_mask = mbox->voq_mask;
+        break;
 
-                        nb_tx = rte_eth_tx_burst(cur_txp->port_id, queue_id,
-                                                 pkts_tx, nb_deq);
+    case DP_MBOX_ADOPT:
+        if (conf) {
+            conf->voq_mask |= mbox->voq_mask;
+            break;
+        }
+        RTE_VERIFY(lp->nb_ports < DP_LCORE_PORT_MAX);
+        conf = &lp->tx.port_list[lp->nb_ports++];
+        memset(conf, 0, sizeof(*conf));
+        conf->port_id = mbox->port_id;
+        conf->voq_mask = mbox->voq_mask;
+        conf->queue_base = mbox->queue_base;
+        break;
 
-                        daqswitch_tx_queue_stats[cur_txp->port_id][queue_id].total_bursts++;
+    default:
+        DP_LOG_ERR("lcore %u: unknown mbox command %u", lp->id, cmd);
+        ret = DP_ERR;
+        break;
+    }
 
-                        /* keep tx until all sent, do not drop packets here */ 
-                        nb_deq -= nb_tx;
-                        pkts_tx += nb_tx;
+    mbox->ret = ret;
+    rte_compiler_barrier();
+    mbox->cmd = DP_MBOX_NONE;
+}
 
-                        if (nb_deq == 0) {
-                            break;
-                        }
+/* features of a tx round, a round is compiled for each combination with
+ * the set as a constant, see the rx side in dp_lcore_data_rx.c */
+/* weighted classes keep to tx_drain_interval > 0 */
+#define TX_V_DRAIN                                                                      0x1
+/* requests under admission control, adm_budget > 0 */
+#define TX_V_ADM                                                                        0x2
+/* data voqs served by event, event_order */
+#define TX_V_ORDER                                                                      0x4
+/* burst_tx below DP_PORT_MAX_PKT_BURST_TX */
+#define TX_V_BURST                                                                      0x8
+#define TX_V_MAX                                                                         16
 
-#if DP_TX_DRAIN_INTERVAL
-                        rte_delay_us(DP_TX_DRAIN_INTERVAL);
+/* adds up to n packets of a voq to the burst gathered for the tx queue
+ * of its class, returns the number of packets taken from the voq */
+static inline __attribute__((always_inline)) uint32_t
+tx_voq_gather(struct tx_pending *txp, uint8_t port_id, uint32_t flow_id,
+              uint16_t queue_id, uint32_t n, const struct dp_tunables_local *tl,
+              const unsigned v)
+{
+    struct dp_voq *in_voq = &dp.voqs[port_id][flow_id];
+    struct data_flow *flow = &dp.flows[port_id][flow_id];
+    struct rte_mbuf **pkts = &txp->pkts[txp->head + txp->n];
+    const bool adm = (v & TX_V_ADM) && tl->t.adm_budget > 0;
+    uint32_t nb_deq;
+#if !defined(DP_LATENCY_STATS_DISABLE) || defined(DP_TCP_MONITOR)
+    uint32_t j;
 #endif
 
-                    }
+    if (unlikely(adm) && flow->req_flow) {
+        nb_deq = adm_dequeue_burst(in_voq, port_id, pkts, n, tl);
+    } else if ((v & TX_V_ORDER) && unlikely(tl->t.event_order) && !flow->req_flow) {
+        nb_deq = order_dequeue_burst(in_voq, pkts, n);
+    } else {
+        nb_deq = voq_dequeue_burst(in_voq, pkts, n);
+    }
+    if (nb_deq == 0) {
+        return 0;
+    }
+
+    daqswitch_tx_queue_stats[port_id][queue_id].total_packets += nb_deq;
+    tx_pending_add(txp, flow_id, adm ? flow->adm_slot : DP_ADM_SLOT_NONE, nb_deq);
 
-#if DP_TX_DRAIN_INTERVAL
-                    last_drain_tsc[port_idx][i] = rte_rdtsc();
+    /* as many as asked for means a backlog, track its peak */
+    if (nb_deq == n) {
+        uint32_t depth = nb_deq + voq_backlog(in_voq);
+
+        if (depth > flow->max_depth) {
+            flow->max_depth = depth;
+        }
+    }
+#ifndef DP_LATENCY_STATS_DISABLE
+    for (j = 0; j < nb_deq; j++) {
+        rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(pkts[j], 0));
+#if defined(DP_EVENT_LATENCY) || defined(DP_TCP_MONITOR)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[j], void *));
 #endif
+    }
+#elif defined(DP_TCP_MONITOR)
+    for (j = 0; j < nb_deq; j++) {
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[j], void *));
+    }
+#endif
+
+    return nb_deq;
+}
+
+#ifdef DP_EGRESS_SCHED
+/* a round of a port (part) in scheduler mode, the scheduler
+ * picks what is sent on the queue of class 0 */
+static inline uint32_t
+tx_port_sched(struct lcore_data_tx_port_conf *cur_txp, struct tx_pending pending[],
+              bool blocked[], const struct dp_tunables_local *tl)
+{
+    const uint8_t port_id = cur_txp->port_id;
+    const uint16_t queue_id = cur_txp->queue_base;
+    struct dp_sched *s = dp_sched_get(port_id, queue_id);
+    uint32_t work;
+
+    work = sched_feed(s, port_id, dp.active_flows[port_id] & cur_txp->voq_mask,
+                      tl->t.burst_tx);
+    if (!blocked[0]) {
+        work += sched_tx(s, &pending[queue_id], port_id, queue_id,
+                         tl->t.burst_tx, &blocked[0]);
+    }
+
+    return work;
+}
+#else
+/* a round of a port (part), classes in priority order, a strict class
+ * skips the drain interval and gets up to DP_TC_STRICT_BURSTS bursts per
+ * voq, a weighted one up to weight bursts in total, its first pass keeps
+ * to the drain interval, the others take the voqs left with a backlog only
+ * the voqs of a class are gathered into full bursts, the rest of the
+ * class leaves in a last burst
+ * returns the number of packets taken from the voqs */
+static inline __attribute__((always_inline)) uint32_t
+tx_port_classes(struct lcore_data_tx_port_conf *cur_txp, struct tx_pending pending[],
+                bool blocked[], uint64_t last_drain_tsc[], const struct dp_tunables_local *tl,
+                const unsigned v)
+{
+    const uint8_t port_id = cur_txp->port_id;
+    const uint32_t burst = (v & TX_V_BURST) ? tl->t.burst_tx : DP_PORT_MAX_PKT_BURST_TX;
+    struct tx_pending *txp;
+    uint64_t flows, backlogged, i;
+    uint32_t nb_deq, room, weight, pass, work = 0;
+    int64_t credit;
+    uint16_t queue_id;
+    uint8_t tc;
+
+    for (tc = 0; tc < DP_TC_MAX; tc++) {
+
+        /* a split port shares its voqs with another lcore */
+        flows = dp.tc_flows[port_id][tc] & cur_txp->voq_mask;
+        if (flows == 0 || blocked[tc]) {
+            continue;
+        }
+
+        queue_id = cur_txp->queue_base + tc;
+        /* the pending buffer of a queue which is not blocked is empty */
+        txp = &pending[queue_id];
+        weight = tl->t.tc_weight[tc];
+        credit = weight ? (int64_t) weight * burst : INT64_MAX;
+
+        for (pass = 0; flows && !blocked[tc] && credit > 0 &&
+                       (weight || pass < DP_TC_STRICT_BURSTS); pass++) {
+
+            for (backlogged = 0; flows; flows &= flows - 1) {
+
+                i = __builtin_ctzll(flows);
+
+                if ((v & TX_V_DRAIN) && weight && pass == 0 &&
+                    rte_rdtsc() - last_drain_tsc[i] < tl->tx_drain_tsc) {
+                    continue;
+                }
+
+                room = burst - txp->n;
+                nb_deq = tx_voq_gather(txp, port_id, i, queue_id, room, tl, v);
+                if (nb_deq == 0) {
+                    continue;
+                }
+
+                work += nb_deq;
+                credit -= nb_deq;
+                if (v & TX_V_DRAIN) {
+                    last_drain_tsc[i] = rte_rdtsc();
+                }
 
+                if (nb_deq == room) {
+                    backlogged |= 1ULL << i;
+                }
+                if (txp->n == burst) {
+                    blocked[tc] = tx_pending_send(txp, port_id, queue_id);
+                }
+                if (blocked[tc] || credit <= 0) {
+                    break;
                 }
-#if DP_TX_DRAIN_INTERVAL
             }
+
+            flows = backlogged;
+        }
+
+        if (!blocked[tc] && txp->n > 0) {
+            blocked[tc] = tx_pending_send(txp, port_id, queue_id);
+        }
+    }
+
+    return work;
+}
+
+typedef uint32_t (*tx_round_t)(struct lcore_data_tx_port_conf *cur_txp, struct tx_pending pending[],
+                               bool blocked[], uint64_t last_drain_tsc[],
+                               const struct dp_tunables_local *tl);
+
+#define TX_ROUND(v)                                                                         \
+static uint32_t                                                                             \
+tx_port_round_##v(struct lcore_data_tx_port_conf *cur_txp, struct tx_pending pending[],     \
+                  bool blocked[], uint64_t last_drain_tsc[],                                \
+                  const struct dp_tunables_local *tl)                                       \
+{                                                                                           \
+    return tx_port_classes(cur_txp, pending, blocked, last_drain_tsc, tl, v);               \
+}
+TX_ROUND(0)  TX_ROUND(1)  TX_ROUND(2)  TX_ROUND(3)
+TX_ROUND(4)  TX_ROUND(5)  TX_ROUND(6)  TX_ROUND(7)
+TX_ROUND(8)  TX_ROUND(9)  TX_ROUND(10) TX_ROUND(11)
+TX_ROUND(12) TX_ROUND(13) TX_ROUND(14) TX_ROUND(15)
+
+static const tx_round_t tx_rounds[TX_V_MAX] = {
+    tx_port_round_0,  tx_port_round_1,  tx_port_round_2,  tx_port_round_3,
+    tx_port_round_4,  tx_port_round_5,  tx_port_round_6,  tx_port_round_7,
+    tx_port_round_8,  tx_port_round_9,  tx_port_round_10, tx_port_round_11,
+    tx_port_round_12, tx_port_round_13, tx_port_round_14, tx_port_round_15,
+};
+
+/* variant of the tx round for the tunables of the lcore */
+static unsigned
+tx_variant(const struct dp_tunables_local *tl)
+{
+    unsigned v = 0;
+
+#ifdef DP_LOOP_VARIANTS_DISABLE
+    v = TX_V_MAX - 1;
+#else
+    if (tl->t.tx_drain_interval > 0) {
+        v |= TX_V_DRAIN;
+    }
+    if (tl->t.adm_budget > 0) {
+        v |= TX_V_ADM;
+    }
+    if (tl->t.event_order) {
+        v |= TX_V_ORDER;
+    }
+    if (tl->t.burst_tx != DP_PORT_MAX_PKT_BURST_TX) {
+        v |= TX_V_BURST;
+    }
 #endif
+
+    return v;
+}
+#endif
+
+void
+dp_main_loop_lcore_data_tx(__attribute__((unused)) struct dp_lcore_params *lp)
+{
+    struct lcore_data_tx_port_conf *cur_txp;
+    uint16_t queue_id;
+    uint8_t port_id, tc;
+    bool blocked[DP_TC_MAX];
+    struct dp_tunables_local tl;
+
+    /* packets taken from the voqs, but not yet accepted by the nic,
+     * indexed by port id as ports move between lcores */
+    struct tx_pending pending[DAQSWITCH_MAX_PORTS][DP_PORT_TXQ_MAX];
+    
+    RTE_VERIFY(lp);
+    RTE_VERIFY(lp->type == DP_LCORE_TYPE_DATA_TX);
+
+    if (lp->nb_ports == 0) {
+        DP_LOG_INFO("lcore %u is idle until the balancer gives it a port", lp->id);
+    }
+
+    memset(pending, 0, sizeof(pending));
+    dp_tunables_local_init(&tl);
+#ifndef DP_EGRESS_SCHED
+    tx_round_t tx_round = tx_rounds[tx_variant(&tl)];
+#endif
+
+    uint64_t last_drain_tsc[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
+    uint64_t round_tsc, now;
+    uint32_t work;
+
+    memset(last_drain_tsc, 0, sizeof(last_drain_tsc));
+    uint8_t port_idx = 0;
+
+    while (1) {
+
+        if (unlikely(lp->mbox.cmd != DP_MBOX_NONE)) {
+            tx_mbox_handle(lp, pending);
+        }
+
+        if (unlikely(lp->nb_ports == 0)) {
+            continue;
+        }
+
+        port_idx %= lp->nb_ports;
+        cur_txp = &lp->tx.port_list[port_idx]; 
+        port_id = cur_txp->port_id;
+        round_tsc = rte_rdtsc();
+
+#ifdef DP_EGRESS_SCHED
+        dp_tunables_refresh(&tl);
+#else
+        if (unlikely(dp_tunables_refresh(&tl))) {
+            tx_round = tx_rounds[tx_variant(&tl)];
+        }
+#endif
+
+        /* retry the leftovers first, a tx queue with leftovers is not
+         * fed from the voqs until they are gone, so a full nic queue does
+         * not block the other ports of this lcore and no packet is dropped */
+        for (tc = 0; tc < DP_TC_MAX; tc++) {
+            queue_id = cur_txp->queue_base + tc;
+            blocked[tc] = tx_pending_flush(&pending[port_id][queue_id],
+                                           port_id, queue_id) > 0;
+        }
+
+#ifdef DP_EGRESS_SCHED
+        work = tx_port_sched(cur_txp, pending[port_id], blocked, &tl);
+#else
+        work = tx_round(cur_txp, pending[port_id], blocked, last_drain_tsc[port_id], &tl);
+#endif
+
+        /* load seen by the balancer */
+        now = rte_rdtsc();
+        lp->load.total_tsc += now - round_tsc;
+        if (work > 0) {
+            lp->load.busy_tsc += now - round_tsc;
+            cur_txp->busy_tsc += now - round_tsc;
         }
 
         port_idx++;
@@ -21,17 +21,66 @@
 #include <rte_tcp.h>
 #include <rte_byteorder.h>
 #include <rte_cycles.h>
+#include <rte_prefetch.h>
+#include <rte_hash.h>
+#include <rte_spinlock.h>
+#ifdef RTE_MACHINE_CPUFLAG_SSE4_2
+#include <rte_hash_crc.h>
+#define DP_KNOWN_FLOWS_HASH_FUNC rte_hash_crc
+#else
+#include <rte_jhash.h>
+#define DP_KNOWN_FLOWS_HASH_FUNC rte_jhash
+#endif
 
 #include "../../daqswitch/daqswitch_port.h"
 #include "../../stats/stats.h"
+#include "../../trace/trace.h"
+#include "../../pipeline/pipeline_metadata.h"
 #include "dp_voq_swq.h"
+#include "dp_tunables.h"
+#include "dp_tc.h"
+#include "dp_admit.h"
 
 #define TDAQ_TYPE_ID_FRAGMENT_REQUEST_MESSAGE          0x00dcdf20 /* big endian */
 
-static struct rte_pipeline *p;
-static uint32_t port_in_id[DAQSWITCH_MAX_PORTS];
-static uint32_t port_out_id[DAQSWITCH_MAX_PORTS];
-static uint32_t table_id;
+/* packets prefetched ahead of the metadata fill */
+#define PKT_PREFETCH_OFFSET                                                8
+
+/* 4 packets at once, debug output is available in the scalar version only */
+#if defined(PIPELINE_METADATA_FILL_X4) && !defined(DAQ_DATA_FLOWS_DBG) && !defined(DAQ_DATA_FLOWS_DUMP_PKT)
+#define PKT_METADATA_FILL_X4
+#endif
+/* tdaq slabs of the flow key */
+#ifdef DAQ_DATA_FLOWS_DISABLE
+#define PKT_METADATA_TDAQ                                                  0
+#else
+#define PKT_METADATA_TDAQ                                                  1
+#endif
+
+/* per default lcore state */
+struct dp_default_ctx {
+    struct rte_pipeline *p;
+    uint32_t port_in_id[DAQSWITCH_MAX_PORTS];
+    uint32_t port_out_id[DAQSWITCH_MAX_PORTS];
+    uint32_t table_id;
+
+    /* default rx/tx queue index */
+    uint16_t queue_idx;
+
+    /* packets received during the last pipeline run */
+    uint32_t nb_pkts;
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    /* set of already provisioned request flows
+     * rss keeps a flow on the same lcore, so the set is per lcore */
+    struct rte_hash *known_flows;
+#endif
+} __rte_cache_aligned;
+
+static struct dp_default_ctx default_ctx[DP_LCORES_DEFAULT];
+
+/* data flows and fdir ids are shared by all default lcores */
+static rte_spinlock_t provision_lock = RTE_SPINLOCK_INITIALIZER;
 static uint16_t fdir_id[DAQSWITCH_MAX_PORTS] = {0};
 
 /* flow key for lpm-based lookups */
@@ -77,6 +126,11 @@ struct pipeline_flow_key {
 
 } __attribute__((__packed__));
 
+/* known flow key: sip, dip, sport and dport are laid out
+ * contiguously in the flow key, so it is hashed in place */
+#define KNOWN_FLOW_KEY(flow_key)            ((const void *) &(flow_key)->sip)
+#define KNOWN_FLOW_KEY_SIZE                                                12 /* bytes */
+
 #ifndef DAQ_DATA_FLOWS_DISABLE
 /* atlas tdaq protocol header */
 struct tdaq_hdr {
@@ -203,261 +257,416 @@ pkt_metadata_fill(struct rte_mbuf *m)
 
 }
 
+/* headers, tdaq header (second cache line) and metadata */
+static inline void
+pkt_prefetch(struct rte_mbuf *m)
+{
+    uint8_t *m_data = rte_pktmbuf_mtod(m, uint8_t *);
+
+    rte_prefetch0(m_data);
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    rte_prefetch0(m_data + CACHE_LINE_SIZE);
+#endif
+    rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(m, 0));
+}
+
 /* default action for all rx packets */
 static int
 rx_action_handler(struct rte_mbuf               **pkts,
                   uint32_t                           n,
                   uint64_t                  *pkts_mask,
-                  __rte_unused void               *arg)
+                  void                             *arg)
 {
-    int i;
+    struct dp_default_ctx *ctx = arg;
+    uint16_t queue_id = DP_PORT_RXQ_ID_DEFAULT + ctx->queue_idx;
+    uint32_t i;
+
+    for (i = 0; i < PKT_PREFETCH_OFFSET && i < n; i++) {
+        pkt_prefetch(pkts[i]);
+    }
 
-    for (i = 0; i < (int) n; i++) {
+    i = 0;
+#ifdef PKT_METADATA_FILL_X4
+    for ( ; i + 4 <= n; i += 4) {
+        uint32_t j;
+
+        for (j = i + PKT_PREFETCH_OFFSET; j < i + PKT_PREFETCH_OFFSET + 4 && j < n; j++) {
+            pkt_prefetch(pkts[j]);
+        }
+
+        pipeline_metadata_fill_x4(&pkts[i], 1, PKT_METADATA_TDAQ);
+    }
+#endif
+    for ( ; i < n; i++) {
+        if (i + PKT_PREFETCH_OFFSET < n) {
+            pkt_prefetch(pkts[i + PKT_PREFETCH_OFFSET]);
+        }
 
         pkt_metadata_fill(pkts[i]);
+    }
+
+#ifndef DP_LATENCY_STATS_DISABLE
+    /* metadata lines are hot after the fill */
+    {
+        const uint64_t rx_tsc = rte_rdtsc();
 
-        daqswitch_rx_queue_stats[pkts[i]->port][DP_PORT_RXQ_ID_DEFAULT].total_packets++;
-        daqswitch_rx_queue_stats[pkts[i]->port][DP_PORT_RXQ_ID_DEFAULT].total_bursts++;
+        for (i = 0; i < n; i++) {
+            DP_MBUF_RX_TSC(pkts[i]) = rx_tsc;
+        }
+    }
+#endif
 
+    /* all packets come from the same port */
+    if (n) {
+        daqswitch_rx_queue_stats[pkts[0]->port][queue_id].total_packets += n;
+        daqswitch_rx_queue_stats[pkts[0]->port][queue_id].total_bursts += n;
     }
 
+    ctx->nb_pkts += n;
+
     *pkts_mask = (~0LLU) >> (64 - n);
     
     return DP_SUCCESS;
 }
 
-#ifndef DAQ_DATA_FLOWS_DISABLE
-/* detect new data flows */
+#ifndef DP_LATENCY_STATS_DISABLE
+/* sojourn time of the packets leaving through a default tx queue */
 static int
-table_action_handler_hit(struct rte_mbuf **pkts, uint64_t *pkts_mask,    
-                         struct rte_pipeline_table_entry **entries, __attribute__((unused)) void *arg)
+port_out_action_handler(struct rte_mbuf *pkt,
+                        __attribute__((unused)) uint64_t *pkt_mask,
+                        void *arg)
 {
-    // todo consider using a separate pipeline table (flow classification)
-    uint64_t pkts_in_mask = *pkts_mask;
-    uint8_t port_idx;
-    int ret;
-    struct lcore_data_tx_port_conf *tx_port_conf;
+    stats_hist_record(arg, rte_rdtsc() - DP_MBUF_RX_TSC(pkt));
 
-    struct rte_fdir_filter filter;
-    memset(&filter, 0, sizeof(struct rte_fdir_filter));
+    return PIPELINE_SUCCESS;
+}
 
-    for ( ; pkts_in_mask; ) {
-        uint64_t pkt_mask;
-        uint32_t pkt_index;
+static int
+port_out_action_handler_bulk(struct rte_mbuf **pkts, uint64_t *pkts_mask,
+                             void *arg)
+{
+    const uint64_t now = rte_rdtsc();
+    uint64_t pkts_in_mask = *pkts_mask;
+    uint32_t pkt_index;
 
+    for ( ; pkts_in_mask; pkts_in_mask &= pkts_in_mask - 1) {
         pkt_index = __builtin_ctzll(pkts_in_mask);
-        pkt_mask = 1LLU << pkt_index;
-        pkts_in_mask &= ~pkt_mask;
+        stats_hist_record(arg, now - DP_MBUF_RX_TSC(pkts[pkt_index]));
+    }
 
-        daqswitch_tx_queue_stats[entries[pkt_index]->port_id][DP_PORT_TXQ_ID_DEFAULT].total_packets++;
-        daqswitch_tx_queue_stats[entries[pkt_index]->port_id][DP_PORT_TXQ_ID_DEFAULT].total_bursts++;
+    return PIPELINE_SUCCESS;
+}
+#endif
 
-        struct rte_mbuf *pkt = pkts[pkt_index];
+#ifndef DAQ_DATA_FLOWS_DISABLE
+/* removes the packets of already provisioned flows from req_mask,
+ * lookups are done in bulk */
+static inline uint64_t
+known_flows_filter(struct rte_hash *known_flows, struct rte_mbuf **pkts, uint64_t req_mask)
+{
+    const void *keys[RTE_HASH_LOOKUP_BULK_MAX];
+    int32_t positions[RTE_HASH_LOOKUP_BULK_MAX];
+    uint32_t pkt_idx[RTE_HASH_LOOKUP_BULK_MAX];
+    uint64_t pkts_in_mask = req_mask;
+    uint32_t i, n;
 
-        /* access metadata in the mbuf headroom */
-        struct pipeline_flow_key *flow_key =
-            (struct pipeline_flow_key *) RTE_MBUF_METADATA_UINT8_PTR(pkt, 0);
+    while (pkts_in_mask) {
 
-        /* new data flow is detected by a new fragment request
-         * going from ros to dcm
-         * ensure also that subsequent packets in the same burst
-         * do not trigger detection for the same flow */
-        //todo for now there might be some race conditions, new fdir filters
-        //might not be created fast enough before new tdaq req message from the
-        //same dcm arrives
-        if (flow_key->type_id == TDAQ_TYPE_ID_FRAGMENT_REQUEST_MESSAGE &&
-             flow_key->sport != filter.port_src) {
+        for (n = 0; pkts_in_mask && n < RTE_HASH_LOOKUP_BULK_MAX; n++) {
+            uint32_t pkt_index = __builtin_ctzll(pkts_in_mask);
+            pkts_in_mask &= ~(1LLU << pkt_index);
 
-            uint32_t lcore_id, flow_id;
-            uint16_t fdir_id_local;
+            pkt_idx[n] = pkt_index;
+            keys[n] = KNOWN_FLOW_KEY((struct pipeline_flow_key *)
+                    RTE_MBUF_METADATA_UINT8_PTR(pkts[pkt_index], 0));
+        }
 
-            /* from ros to dcm */
-#ifdef DAQ_DATA_FLOWS_DBG
-            printf("#### new data flow detected\n");
-            printf("\tconfiguring ros->dcm path\n");
-            fflush(stdout);
-#endif
-            tx_port_conf = NULL;
-            for (lcore_id = 0; lcore_id < dp.nb_lcores; lcore_id++) {
-                if (dp.lcores[lcore_id].type != DP_LCORE_TYPE_DATA_TX) {
-                    continue;
-                }
-                for (port_idx = 0; port_idx < dp.lcores[lcore_id].nb_ports; port_idx++) {
-                    if (dp.lcores[lcore_id].tx.port_list[port_idx].port_id == pkt->port) {
-                        tx_port_conf = &dp.lcores[lcore_id].tx.port_list[port_idx];
-                    }
-                }
+        rte_hash_lookup_bulk(known_flows, keys, n, positions);
+
+        for (i = 0; i < n; i++) {
+            if (positions[i] >= 0) {
+                req_mask &= ~(1LLU << pkt_idx[i]);
             }
-            RTE_VERIFY(tx_port_conf != NULL);
+        }
+    }
 
-            for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
-                if (dp.flows[pkt->port][flow_id].active == true &&
-                    dp.flows[pkt->port][flow_id].dest_ip == flow_key->sip &&
-                    dp.flows[pkt->port][flow_id].sink_id == flow_key->event_id) {
+    return req_mask;
+}
 
-                    fdir_id_local = flow_id;
-                    break;
+/* provisions both paths of a new data flow detected by
+ * a fragment request pkt received on port_id
+ * must be called with provision_lock held */
+static int
+provision_data_flow(struct rte_mbuf *pkt, uint8_t port_id,
+                    struct pipeline_flow_key *flow_key)
+{
+    uint32_t flow_id;
+    uint16_t fdir_id_local;
+    int ret;
 
-                }
-            }
+    /* both voqs are classified on the request */
+    struct ipv4_hdr *ip_hdr = (struct ipv4_hdr *)
+        &rte_pktmbuf_mtod(pkt, uint8_t *)[sizeof(struct ether_hdr)];
+    const uint8_t dscp = ip_hdr->type_of_service >> 2;
+    const uint16_t ros_port = rte_be_to_cpu_16(flow_key->dport);
 
-            if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
+    struct rte_fdir_filter filter;
+    memset(&filter, 0, sizeof(struct rte_fdir_filter));
+
+    TRACE(FLOW_DETECTED, pkt->port, port_id, flow_key->event_id);
+
+    /* from ros to dcm */
 #ifdef DAQ_DATA_FLOWS_DBG
-                printf("\tqueue already active %d\n", flow_id);
-                fflush(stdout);
+    printf("#### new data flow detected\n");
+    printf("\tconfiguring ros->dcm path\n");
+    fflush(stdout);
 #endif
+    for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
+        if (dp.flows[pkt->port][flow_id].active == true &&
+            dp.flows[pkt->port][flow_id].dest_ip == flow_key->sip &&
+            dp.flows[pkt->port][flow_id].sink_id == flow_key->event_id) {
+
+            fdir_id_local = flow_id;
+            break;
 
-            } else { 
+        }
+    }
 
-                for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
-                    if (dp.flows[pkt->port][flow_id].active == false) {
-                        //todo not thread-safe
-                        dp.flows[pkt->port][flow_id].active = true;
+    if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
+#ifdef DAQ_DATA_FLOWS_DBG
+        printf("\tqueue already active %d\n", flow_id);
+        fflush(stdout);
+#endif
 
-                        dp.flows[pkt->port][flow_id].dest_ip = flow_key->sip;
-                        dp.flows[pkt->port][flow_id].sink_id = flow_key->event_id;
-                        dp.flows[pkt->port][flow_id].req_flow = false;
+    } else { 
 
-                        fdir_id_local = flow_id;
-                        /* activate ring polling */
-                        tx_port_conf->active_flows |= (1 << flow_id);
+        for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
+            if (dp.flows[pkt->port][flow_id].active == false) {
+                //todo not thread-safe
+                dp.flows[pkt->port][flow_id].active = true;
 
-                        break;
+                dp.flows[pkt->port][flow_id].dest_ip = flow_key->sip;
+                dp.flows[pkt->port][flow_id].sink_id = flow_key->event_id;
+                dp.flows[pkt->port][flow_id].req_flow = false;
+                dp.flows[pkt->port][flow_id].tc =
+                    dp_tc_classify(DP_TC_KIND_DATA, ros_port, dscp);
+                dp.flows[pkt->port][flow_id].adm_slot = dp_adm_learn(flow_key->sip);
 
-                    }
-                }
+                fdir_id_local = flow_id;
+                /* activate ring polling */
+                dp.tc_flows[pkt->port][dp.flows[pkt->port][flow_id].tc] |= 1ULL << flow_id;
+                dp.active_flows[pkt->port] |= 1ULL << flow_id;
+                TRACE(VOQ_ACTIVATED, pkt->port, flow_id, flow_key->event_id);
+
+                break;
 
-                if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
-#ifdef DAQ_DATA_FLOWS_DBG
-                    printf("\tfree filter found fdir id %d\n", fdir_id_local);
-                    fflush(stdout);
-#endif
-                } else {
-                    DP_LOG_INFO("warning: no more filters available for new ros(%d)->dcm(%d) data flow",
-                                 entries[pkt_index]->port_id, pkt->port);
-                    continue;
-                }
             }
+        }
 
-            filter.l4type = RTE_FDIR_L4TYPE_TCP;
-            filter.ip_dst.ipv4_addr = flow_key->sip;
-            filter.port_dst = flow_key->sport;
-            filter.ip_src.ipv4_addr = flow_key->dip;
-            filter.port_src = flow_key->dport;
-
-            fdir_id[entries[pkt_index]->port_id]++;
-            fdir_id_local |= (fdir_id[entries[pkt_index]->port_id] << DP_FDIR_OUT_QUEUE_MASK_SIZE);
-
-            ret = rte_eth_dev_fdir_add_perfect_filter(entries[pkt_index]->port_id,
-                                                      &filter,
-                                                      fdir_id_local,
-                                                      pkt->port + DP_PORT_RXQ_ID_DATA_MIN,
-                                                      0);
-            RTE_VERIFY(ret == 0);
-            
+        if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
 #ifdef DAQ_DATA_FLOWS_DBG
-            printf("\tnew filter p:q %d:%d "
-                    "ros->dcm flow 0x%08x:%d->0x%08x:%d id 0x%08x fdir:%d\n",
-                    entries[pkt_index]->port_id, pkt->port + DP_PORT_RXQ_ID_DATA_MIN,
-                    rte_be_to_cpu_32(filter.ip_src.ipv4_addr), rte_be_to_cpu_16(filter.port_src),
-                    rte_be_to_cpu_32(filter.ip_dst.ipv4_addr), rte_be_to_cpu_16(filter.port_dst),
-                    flow_key->event_id, fdir_id_local);
+            printf("\tfree filter found fdir id %d\n", fdir_id_local);
             fflush(stdout);
 #endif
+        } else {
+            DP_LOG_INFO("warning: no more filters available for new ros(%d)->dcm(%d) data flow",
+                         port_id, pkt->port);
+            return PIPELINE_ERR;
+        }
+    }
 
-            /* from dcm to ros */
+    filter.l4type = RTE_FDIR_L4TYPE_TCP;
+    filter.ip_dst.ipv4_addr = flow_key->sip;
+    filter.port_dst = flow_key->sport;
+    filter.ip_src.ipv4_addr = flow_key->dip;
+    filter.port_src = flow_key->dport;
+
+    fdir_id[port_id]++;
+    fdir_id_local |= (fdir_id[port_id] << DP_FDIR_OUT_QUEUE_MASK_SIZE);
+
+    ret = rte_eth_dev_fdir_add_perfect_filter(port_id,
+                                              &filter,
+                                              fdir_id_local,
+                                              pkt->port + DP_PORT_RXQ_ID_DATA_MIN,
+                                              0);
+    RTE_VERIFY(ret == 0);
+    TRACE(FILTER_ADDED, port_id, pkt->port + DP_PORT_RXQ_ID_DATA_MIN, fdir_id_local);
+    
 #ifdef DAQ_DATA_FLOWS_DBG
-            printf("\tconfiguring dcm->ros path\n");
-            fflush(stdout);
+    printf("\tnew filter p:q %d:%d "
+            "ros->dcm flow 0x%08x:%d->0x%08x:%d id 0x%08x fdir:%d\n",
+            port_id, pkt->port + DP_PORT_RXQ_ID_DATA_MIN,
+            rte_be_to_cpu_32(filter.ip_src.ipv4_addr), rte_be_to_cpu_16(filter.port_src),
+            rte_be_to_cpu_32(filter.ip_dst.ipv4_addr), rte_be_to_cpu_16(filter.port_dst),
+            flow_key->event_id, fdir_id_local);
+    fflush(stdout);
 #endif
-            tx_port_conf = NULL;
-            for (lcore_id = 0; lcore_id < dp.nb_lcores; lcore_id++) {
-                if (dp.lcores[lcore_id].type != DP_LCORE_TYPE_DATA_TX) {
-                    continue;
-                }
-                for (port_idx = 0; port_idx < dp.lcores[lcore_id].nb_ports; port_idx++) {
-                    if (dp.lcores[lcore_id].tx.port_list[port_idx].port_id == entries[pkt_index]->port_id) {
-                        tx_port_conf = &dp.lcores[lcore_id].tx.port_list[port_idx];
-                    }
-                }
-            }
-            RTE_VERIFY(tx_port_conf != NULL);
 
-            for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
-                if (dp.flows[entries[pkt_index]->port_id][flow_id].active == true &&
-                    dp.flows[entries[pkt_index]->port_id][flow_id].dest_ip == flow_key->dip &&
-                    dp.flows[entries[pkt_index]->port_id][flow_id].sink_id == 0xffffffff) {
+    /* from dcm to ros */
+#ifdef DAQ_DATA_FLOWS_DBG
+    printf("\tconfiguring dcm->ros path\n");
+    fflush(stdout);
+#endif
+    for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
+        if (dp.flows[port_id][flow_id].active == true &&
+            dp.flows[port_id][flow_id].dest_ip == flow_key->dip &&
+            dp.flows[port_id][flow_id].sink_id == 0xffffffff) {
 
-                    fdir_id_local = flow_id;
+            fdir_id_local = flow_id;
 
-                    break;
+            break;
 
-                }
-            }
+        }
+    }
 
-            if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
+    if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
 #ifdef DAQ_DATA_FLOWS_DBG
-                printf("\tqueue already active %d\n", flow_id);
-                fflush(stdout);
+        printf("\tqueue already active %d\n", flow_id);
+        fflush(stdout);
 #endif
-            } else {
+    } else {
 
-                for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
-                    if (dp.flows[entries[pkt_index]->port_id][flow_id].active == false) {
-                        //todo not thread-safe
-                        dp.flows[entries[pkt_index]->port_id][flow_id].active = true;
+        for (flow_id = 0; flow_id < DP_PORT_MAX_DATA_FLOWS; flow_id++) {
+            if (dp.flows[port_id][flow_id].active == false) {
+                //todo not thread-safe
+                dp.flows[port_id][flow_id].active = true;
 
-                        dp.flows[entries[pkt_index]->port_id][flow_id].dest_ip = flow_key->dip;
-                        dp.flows[entries[pkt_index]->port_id][flow_id].sink_id = 0xffffffff;
-                        dp.flows[entries[pkt_index]->port_id][flow_id].req_flow = true;
+                dp.flows[port_id][flow_id].dest_ip = flow_key->dip;
+                dp.flows[port_id][flow_id].sink_id = 0xffffffff;
+                dp.flows[port_id][flow_id].req_flow = true;
+                dp.flows[port_id][flow_id].tc =
+                    dp_tc_classify(DP_TC_KIND_REQ, ros_port, dscp);
+                dp.flows[port_id][flow_id].adm_slot = DP_ADM_SLOT_NONE;
 
-                        fdir_id_local = flow_id;
-                        /* activate ring polling */
-                        tx_port_conf->active_flows |= (1 << flow_id);
+                fdir_id_local = flow_id;
+                /* activate ring polling */
+                dp.tc_flows[port_id][dp.flows[port_id][flow_id].tc] |= 1ULL << flow_id;
+                dp.active_flows[port_id] |= 1ULL << flow_id;
+                TRACE(VOQ_ACTIVATED, port_id, flow_id, 0xffffffff);
 
-                        break;
+                break;
 
-                    }
-                }
             }
+        }
+    }
 
-            if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
+    if (flow_id < DP_PORT_MAX_DATA_FLOWS) {
 #ifdef DAQ_DATA_FLOWS_DBG
-                printf("\tfree filter found fdir id %d\n", fdir_id_local);
-                fflush(stdout);
+        printf("\tfree filter found fdir id %d\n", fdir_id_local);
+        fflush(stdout);
 #endif
-            } else {
-                DP_LOG_INFO("warning: no more filters available for new dcm(%d)->ros(%d) data flow",
-                             pkt->port, entries[pkt_index]->port_id);
-                continue;
-            }
+    } else {
+        DP_LOG_INFO("warning: no more filters available for new dcm(%d)->ros(%d) data flow",
+                     pkt->port, port_id);
+        return PIPELINE_ERR;
+    }
 
-            filter.l4type = RTE_FDIR_L4TYPE_TCP;
-            filter.ip_dst.ipv4_addr = flow_key->dip;
-            filter.port_dst = flow_key->dport;
-            filter.ip_src.ipv4_addr = flow_key->sip;
-            filter.port_src = flow_key->sport;
+    filter.l4type = RTE_FDIR_L4TYPE_TCP;
+    filter.ip_dst.ipv4_addr = flow_key->dip;
+    filter.port_dst = flow_key->dport;
+    filter.ip_src.ipv4_addr = flow_key->sip;
+    filter.port_src = flow_key->sport;
 
-            fdir_id[pkt->port]++;
-            fdir_id_local |= (fdir_id[pkt->port] << DP_FDIR_OUT_QUEUE_MASK_SIZE);
+    fdir_id[pkt->port]++;
+    fdir_id_local |= (fdir_id[pkt->port] << DP_FDIR_OUT_QUEUE_MASK_SIZE);
 
-            ret = rte_eth_dev_fdir_add_perfect_filter(pkt->port,
-                                                      &filter,
-                                                      fdir_id_local,
-                                                      entries[pkt_index]->port_id + DP_PORT_RXQ_ID_DATA_MIN,
-                                                      0);
-            RTE_VERIFY(ret == 0);
+    ret = rte_eth_dev_fdir_add_perfect_filter(pkt->port,
+                                              &filter,
+                                              fdir_id_local,
+                                              port_id + DP_PORT_RXQ_ID_DATA_MIN,
+                                              0);
+    RTE_VERIFY(ret == 0);
+    TRACE(FILTER_ADDED, pkt->port, port_id + DP_PORT_RXQ_ID_DATA_MIN, fdir_id_local);
 
 #ifdef DAQ_DATA_FLOWS_DBG
-            printf("\tnew filter p:q %d:%d "
-                    "dcm->ros flow 0x%08x:%d->0x%08x:%d id 0x%08x fdir:%d\n",
-                    pkt->port, entries[pkt_index]->port_id + DP_PORT_RXQ_ID_DATA_MIN,
-                    rte_be_to_cpu_32(filter.ip_src.ipv4_addr), rte_be_to_cpu_16(filter.port_src),
-                    rte_be_to_cpu_32(filter.ip_dst.ipv4_addr), rte_be_to_cpu_16(filter.port_dst),
-                    flow_key->event_id, fdir_id_local);
-            printf("###\n");
-            fflush(stdout);
+    printf("\tnew filter p:q %d:%d "
+            "dcm->ros flow 0x%08x:%d->0x%08x:%d id 0x%08x fdir:%d\n",
+            pkt->port, port_id + DP_PORT_RXQ_ID_DATA_MIN,
+            rte_be_to_cpu_32(filter.ip_src.ipv4_addr), rte_be_to_cpu_16(filter.port_src),
+            rte_be_to_cpu_32(filter.ip_dst.ipv4_addr), rte_be_to_cpu_16(filter.port_dst),
+            flow_key->event_id, fdir_id_local);
+    printf("###\n");
+    fflush(stdout);
 #endif
+
+    return PIPELINE_SUCCESS;
+}
+
+/* detect new data flows */
+static int
+table_action_handler_hit(struct rte_mbuf **pkts, uint64_t *pkts_mask,    
+                         struct rte_pipeline_table_entry **entries, void *arg)
+{
+    // todo consider using a separate pipeline table (flow classification)
+    struct dp_default_ctx *ctx = arg;
+    uint16_t queue_id = DP_PORT_TXQ_ID_DEFAULT + ctx->queue_idx;
+    uint64_t pkts_in_mask = *pkts_mask;
+    uint64_t pkts_req_mask = 0;
+    uint32_t nb_provisioned = 0;
+    int ret;
+
+    /* stats and request candidates */
+    for ( ; pkts_in_mask; ) {
+        uint64_t pkt_mask;
+        uint32_t pkt_index;
+
+        pkt_index = __builtin_ctzll(pkts_in_mask);
+        pkt_mask = 1LLU << pkt_index;
+        pkts_in_mask &= ~pkt_mask;
+
+        daqswitch_tx_queue_stats[entries[pkt_index]->port_id][queue_id].total_packets++;
+        daqswitch_tx_queue_stats[entries[pkt_index]->port_id][queue_id].total_bursts++;
+
+        struct pipeline_flow_key *flow_key =
+            (struct pipeline_flow_key *) RTE_MBUF_METADATA_UINT8_PTR(pkts[pkt_index], 0);
+
+        if (flow_key->type_id == TDAQ_TYPE_ID_FRAGMENT_REQUEST_MESSAGE) {
+            pkts_req_mask |= pkt_mask;
+        }
+    }
+
+    /* requests of already provisioned flows need no further work */
+    if (pkts_req_mask) {
+        pkts_req_mask = known_flows_filter(ctx->known_flows, pkts, pkts_req_mask);
+    }
+
+    for (pkts_in_mask = pkts_req_mask; pkts_in_mask; ) {
+        uint64_t pkt_mask;
+        uint32_t pkt_index;
+
+        pkt_index = __builtin_ctzll(pkts_in_mask);
+        pkt_mask = 1LLU << pkt_index;
+        pkts_in_mask &= ~pkt_mask;
+
+        struct rte_mbuf *pkt = pkts[pkt_index];
+
+        /* access metadata in the mbuf headroom */
+        struct pipeline_flow_key *flow_key =
+            (struct pipeline_flow_key *) RTE_MBUF_METADATA_UINT8_PTR(pkt, 0);
+
+        /* new data flow is detected by a new fragment request
+         * going from ros to dcm
+         * ensure also that subsequent packets in the same burst
+         * do not trigger detection for the same flow */
+        //todo for now there might be some race conditions, new fdir filters
+        //might not be created fast enough before new tdaq req message from the
+        //same dcm arrives
+        if (nb_provisioned == 0 ||
+            rte_hash_lookup(ctx->known_flows, KNOWN_FLOW_KEY(flow_key)) < 0) {
+
+            rte_spinlock_lock(&provision_lock);
+            ret = provision_data_flow(pkt, entries[pkt_index]->port_id, flow_key);
+            rte_spinlock_unlock(&provision_lock);
+            if (ret != PIPELINE_SUCCESS) {
+                continue;
+            }
+
+            /* both paths are provisioned now */
+            ret = rte_hash_add_key(ctx->known_flows, KNOWN_FLOW_KEY(flow_key));
+            if (ret < 0) {
+                DP_LOG_DEBUG("known flows table full, flow will be re-detected");
+            }
+            nb_provisioned++;
         }
 
     }
@@ -467,12 +676,15 @@ table_action_handler_hit(struct rte_mbuf **pkts, uint64_t *pkts_mask,
 #endif
 
 /* add single ipv4 rule to the rx_default pipeline
- * port_out_id is dpdk port id */
+ * port_out_id is dpdk port id
+ * the forwarding table is replicated in the pipeline
+ * of each default lcore */
 //todo make it static, messaging
 int
 add_ipv4_rule(uint32_t ipv4, uint8_t port_out_id)
 {
     int ret;
+    uint16_t i;
 
     DP_LOG_ENTRY();
 
@@ -491,13 +703,19 @@ add_ipv4_rule(uint32_t ipv4, uint8_t port_out_id)
     int key_found;
     struct rte_pipeline_table_entry *entry_ptr;
 
-    ret = rte_pipeline_table_entry_add(p,
-                                       table_id,
-                                       &key,
-                                       &entry,
-                                       &key_found,
-                                       &entry_ptr);
-    DP_LOG_AND_RETURN_ON_ERR("failed to entry to pipeline");
+    for (i = 0; i < DP_LCORES_DEFAULT; i++) {
+        if (default_ctx[i].p == NULL) {
+            continue;
+        }
+
+        ret = rte_pipeline_table_entry_add(default_ctx[i].p,
+                                           default_ctx[i].table_id,
+                                           &key,
+                                           &entry,
+                                           &key_found,
+                                           &entry_ptr);
+        DP_LOG_AND_RETURN_ON_ERR("failed to entry to pipeline %d", i);
+    }
 
     DP_LOG_EXIT();
 
@@ -514,14 +732,25 @@ dp_configure_lcore_default(struct dp_lcore_params *lp)
 {
     int ret;
     uint16_t i;
+    char s[64];
     
     DP_LOG_ENTRY();
 
-    RTE_VERIFY(p == 0);
+    RTE_VERIFY(lp->dflt.queue_idx < DP_LCORES_DEFAULT);
+#ifndef DP_LATENCY_STATS_DISABLE
+    /* the rx tsc must not overlap the flow key */
+    RTE_BUILD_BUG_ON(sizeof(struct pipeline_pkt_metadata) > DP_MBUF_META_RX_TSC_OFFSET);
+#endif
+
+    struct dp_default_ctx *ctx = &default_ctx[lp->dflt.queue_idx];
+    RTE_VERIFY(ctx->p == 0);
+
+    ctx->queue_idx = lp->dflt.queue_idx;
 
     /* pipeline configuration */
+    snprintf(s, sizeof(s), "pipeline_default_%d", ctx->queue_idx);
     struct rte_pipeline_params rte_params = {
-        .name = "pipeline_default",
+        .name = s,
         .socket_id = rte_lcore_to_socket_id(lp->id),
     };
 
@@ -529,33 +758,33 @@ dp_configure_lcore_default(struct dp_lcore_params *lp)
                   rte_params.name,
                   lp->id,
                   rte_params.socket_id);
-    p = rte_pipeline_create(&rte_params);
-    RTE_VERIFY(p);
+    ctx->p = rte_pipeline_create(&rte_params);
+    RTE_VERIFY(ctx->p);
 
     /* input port configuration */
     DAQSWITCH_PORT_FOREACH(i) {
         struct rte_port_ethdev_reader_params port_ethdev_params = {
             .port_id = i,
-            .queue_id = DP_PORT_RXQ_ID_DEFAULT,
+            .queue_id = DP_PORT_RXQ_ID_DEFAULT + ctx->queue_idx,
         };
 
         struct rte_pipeline_port_in_params port_params = {
             .ops = &rte_port_ethdev_reader_ops,
             .arg_create = (void *) &port_ethdev_params,
             .f_action = rx_action_handler,
-            .arg_ah = NULL,
+            .arg_ah = ctx,
             .burst_size = DP_PORT_MAX_PKT_BURST_RX,
         };
 
-        ret = rte_pipeline_port_in_create(p,
+        ret = rte_pipeline_port_in_create(ctx->p,
                                           &port_params,
-                                          &port_in_id[i]);
+                                          &ctx->port_in_id[i]);
         RTE_VERIFY(ret == 0);
 
         DP_LOG_DEBUG("\tcreated port in: port id %d queue id %d pipeline port id: %d",
                             port_ethdev_params.port_id,
                             port_ethdev_params.queue_id,
-                            port_in_id[i]);
+                            ctx->port_in_id[i]);
     }
 
     /* pipeline forwarding table configuration */
@@ -576,14 +805,14 @@ dp_configure_lcore_default(struct dp_lcore_params *lp)
 #else
             .f_action_hit = NULL,
 #endif
-            .arg_ah = NULL,
+            .arg_ah = ctx,
             .action_data_size = 0,
         };
 
         DP_LOG_DEBUG("\tcreating lpm table");
-        ret = rte_pipeline_table_create(p,
+        ret = rte_pipeline_table_create(ctx->p,
                                         &table_params,
-                                        &table_id);
+                                        &ctx->table_id);
         RTE_VERIFY(ret == 0);
     }
 
@@ -591,61 +820,106 @@ dp_configure_lcore_default(struct dp_lcore_params *lp)
     DAQSWITCH_PORT_FOREACH(i) {
         struct rte_port_ethdev_writer_params port_ethdev_params = {
             .port_id = i,
-            .queue_id = DP_PORT_TXQ_ID_DEFAULT,
+            .queue_id = DP_PORT_TXQ_ID_DEFAULT + ctx->queue_idx,
             .tx_burst_sz = DP_PORT_MAX_PKT_BURST_RX,
         };
 
         struct rte_pipeline_port_out_params port_params = {
             .ops = &rte_port_ethdev_writer_ops,
             .arg_create = (void *) &port_ethdev_params,
+#ifndef DP_LATENCY_STATS_DISABLE
+            .f_action = port_out_action_handler,
+            .f_action_bulk = port_out_action_handler_bulk,
+            .arg_ah = dp.port_sojourn[i][DP_PORT_TXQ_ID_DEFAULT + ctx->queue_idx],
+#else
             .f_action = NULL,
             .f_action_bulk = NULL,
             .arg_ah = NULL,
+#endif
         };
 
-        ret = rte_pipeline_port_out_create(p,
+        ret = rte_pipeline_port_out_create(ctx->p,
                                            &port_params,
-                                           &port_out_id[i]);
+                                           &ctx->port_out_id[i]);
         RTE_VERIFY(ret == 0);
 
         DP_LOG_DEBUG("\tcreated port out: port id %d queue id %d pipeline port id: %d",
                             port_ethdev_params.port_id,
                             port_ethdev_params.queue_id,
-                            port_out_id[i]);
+                            ctx->port_out_id[i]);
     }
 
     /* interconnect ports */
     DAQSWITCH_PORT_FOREACH(i) {
-        ret = rte_pipeline_port_in_connect_to_table(p,
-                                                    port_in_id[i],
-                                                    table_id);
+        ret = rte_pipeline_port_in_connect_to_table(ctx->p,
+                                                    ctx->port_in_id[i],
+                                                    ctx->table_id);
         RTE_VERIFY(ret == 0);
     }
 
     /* enable ports */
     DAQSWITCH_PORT_FOREACH(i) {
-        ret = rte_pipeline_port_in_enable(p, 
-                                          port_in_id[i]);
+        ret = rte_pipeline_port_in_enable(ctx->p, 
+                                          ctx->port_in_id[i]);
         RTE_VERIFY(ret == 0);
     }
 
     /* check pipeline consistency */
-    RTE_VERIFY(rte_pipeline_check(p) == 0);
+    RTE_VERIFY(rte_pipeline_check(ctx->p) == 0);
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    /* known flows table */
+    {
+        snprintf(s, sizeof(s), "dp_known_flows_%d", ctx->queue_idx);
+        struct rte_hash_parameters hash_params = {
+            .name = s,
+            .entries = DP_KNOWN_FLOWS_MAX,
+            .bucket_entries = DP_KNOWN_FLOWS_BUCKET_ENTRIES,
+            .key_len = KNOWN_FLOW_KEY_SIZE,
+            .hash_func = DP_KNOWN_FLOWS_HASH_FUNC,
+            .hash_func_init_val = 0,
+            .socket_id = rte_lcore_to_socket_id(lp->id),
+        };
+
+        DP_LOG_DEBUG("\tcreating known flows table");
+        ctx->known_flows = rte_hash_create(&hash_params);
+        RTE_VERIFY(ctx->known_flows);
+    }
+#endif
 
     DP_LOG_EXIT();
 
 }
 
+/* runs the pipeline back to back while there is traffic,
+ * when idle the delay between runs grows exponentially
+ * up to the default_run_interval tunable */
 void
-dp_main_loop_lcore_default(__attribute__((unused)) struct dp_lcore_params *lp)
+dp_main_loop_lcore_default(struct dp_lcore_params *lp)
 {
-    RTE_VERIFY(p);
+    struct dp_default_ctx *ctx = &default_ctx[lp->dflt.queue_idx];
+    struct dp_tunables_local tl;
+    uint32_t idle_us = 0;
+
+    RTE_VERIFY(ctx->p);
+
+    dp_tunables_local_init(&tl);
 
     while (1) {
 
-        rte_pipeline_run(p);
-        rte_pipeline_flush(p);
-        rte_delay_us(DP_DEFAULT_PIPELINE_RUN_INTERVAL);
+        ctx->nb_pkts = 0;
+
+        rte_pipeline_run(ctx->p);
+        rte_pipeline_flush(ctx->p);
+
+        if (ctx->nb_pkts) {
+            idle_us = 0;
+            continue;
+        }
+
+        dp_tunables_refresh(&tl);
+        idle_us = idle_us ? RTE_MIN(idle_us << 1, tl.t.default_run_interval) : 1;
+        rte_delay_us(idle_us);
 
     }
 }
@@ -0,0 +1,103 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+
+#include <rte_malloc.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_byteorder.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
+#include "../../pipeline/pipeline.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tdaq.h"
+#include "dp_order.h"
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+/* requests per dcm port, written by the rx lcore of the port only,
+ * response connections per ros port, rx lcore of the port only */
+static struct dp_tdaq_req *order_reqs[DAQSWITCH_MAX_PORTS];
+static struct dp_tdaq_conn *order_conns[DAQSWITCH_MAX_PORTS];
+
+/* remembers the event id of a request received on a dcm port */
+static inline void
+order_req_rx(uint8_t dcm_port_id, struct rte_mbuf *pkt)
+{
+    struct ipv4_hdr *ip_hdr;
+    const struct tdaq_hdr *hdr;
+    struct tdaq_hdr hdr_buf;
+
+    hdr = dp_tdaq_req_hdr(pkt, &ip_hdr, &hdr_buf);
+    if (hdr == NULL) {
+        return;
+    }
+
+    dp_tdaq_req_store(order_reqs[dcm_port_id], DP_ORDER_REQ_TABLE_SIZE,
+                      ip_hdr->src_addr, ip_hdr->dst_addr, hdr->transactionId,
+                      DP_EVENT_TAG(hdr->event_id));
+}
+
+/* tags a packet of a ros->dcm connection with the event of the response
+ * its first byte belongs to, untagged if not known */
+static inline void
+order_resp_rx(uint8_t ros_port_id, uint8_t dcm_port_id, struct rte_mbuf *pkt)
+{
+    DP_MBUF_EVENT(pkt) = dp_tdaq_resp_follow(order_conns[ros_port_id], DP_ORDER_CONN_TABLE_SIZE,
+                                             order_reqs[dcm_port_id], DP_ORDER_REQ_TABLE_SIZE,
+                                             pkt, NULL, NULL);
+}
+
+void
+dp_order_init(void)
+{
+    uint8_t i;
+    char s[64];
+
+    DP_LOG_ENTRY();
+
+    DAQSWITCH_PORT_FOREACH(i) {
+        snprintf(s, sizeof(s), "dp_order_reqs_p%d", i);
+        order_reqs[i] = rte_zmalloc_socket(s, DP_ORDER_REQ_TABLE_SIZE * sizeof(struct dp_tdaq_req),
+                                           CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+        RTE_VERIFY(order_reqs[i]);
+
+        snprintf(s, sizeof(s), "dp_order_conns_p%d", i);
+        order_conns[i] = rte_zmalloc_socket(s, DP_ORDER_CONN_TABLE_SIZE * sizeof(struct dp_tdaq_conn),
+                                            CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+        RTE_VERIFY(order_conns[i]);
+    }
+
+    DP_LOG_EXIT();
+}
+
+/* called by the rx lcore of in_port_id for packets of voq flow_id of
+ * out_port_id, before they are enqueued */
+void
+dp_order_rx(uint8_t in_port_id, uint8_t out_port_id, uint8_t flow_id,
+            struct rte_mbuf **pkts, unsigned n)
+{
+    unsigned i;
+
+    if (dp.flows[out_port_id][flow_id].req_flow) {
+        for (i = 0; i < n; i++) {
+            order_req_rx(in_port_id, pkts[i]);
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            order_resp_rx(in_port_id, out_port_id, pkts[i]);
+        }
+    }
+}
+#endif
@@ -0,0 +1,69 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_ORDER_H
+#define DP_ORDER_H
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+/* event-aware egress ordering, the event_order tunable
+ *
+ * the rx lcore of a dcm port remembers the event id of the fragment
+ * requests it forwards, the rx lcore of a ros port follows the response
+ * stream of every connection and tags each response packet with the
+ * event id of its request, the tx lcore of the dcm port then serves the
+ * lane of a data voq with the oldest event at its head first, so the
+ * fragments of an event leave together and the events of a dcm complete
+ * one after another instead of all of them in parallel
+ * assumes that a response header is never split over two segments, the
+ * responses to requests not seen, like the very first request of a data
+ * flow which goes through the default pipeline, are left untagged and
+ * served first, so they never wait behind tagged ones */
+#ifndef DP_EVENT_ORDER
+    #define DP_EVENT_ORDER                                                                0
+#endif
+/* requests remembered per dcm port, older ones are overwritten */
+#ifndef DP_ORDER_REQ_TABLE_SIZE
+    #define DP_ORDER_REQ_TABLE_SIZE                                                    4096
+#endif
+/* response tcp connections followed per ros port */
+#ifndef DP_ORDER_CONN_TABLE_SIZE
+    #define DP_ORDER_CONN_TABLE_SIZE                                                   4096
+#endif
+
+/* event tag stamped into the mbuf metadata after the rx tsc */
+#define DP_MBUF_META_EVENT_OFFSET                                                        40
+#define DP_MBUF_EVENT(m)                 RTE_MBUF_METADATA_UINT64(m, DP_MBUF_META_EVENT_OFFSET)
+#define DP_EVENT_UNTAGGED                                                                 0
+#define DP_EVENT_TAG(event_id)                          ((1ULL << 32) | (uint32_t) (event_id))
+
+/* 1 if tag a is to be served before tag b, event ids are compared
+ * as serial numbers, so they may wrap */
+static inline int
+dp_event_older(uint64_t a, uint64_t b)
+{
+    if (a == DP_EVENT_UNTAGGED) {
+        return b != DP_EVENT_UNTAGGED;
+    }
+    if (b == DP_EVENT_UNTAGGED) {
+        return 0;
+    }
+
+    return (int32_t) ((uint32_t) a - (uint32_t) b) < 0;
+}
+
+void dp_order_init(void);
+void dp_order_rx(uint8_t in_port_id, uint8_t out_port_id, uint8_t flow_id,
+                 struct rte_mbuf **pkts, unsigned n);
+
+#endif /* DP_ORDER_H */
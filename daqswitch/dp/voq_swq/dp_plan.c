@@ -0,0 +1,215 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_lcore.h>
+#include <rte_ethdev.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch.h"
+#include "../../daqswitch/daqswitch_port.h"
+
+#include "dp_voq_swq.h"
+#include "dp_plan.h"
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+struct dp_plan dp_plan;
+
+static inline unsigned
+lcore_socket(const struct dp_lcore_params *lp)
+{
+    return get_socket_id(lp->id);
+}
+
+/* roles of the lcores not used by the default pipeline
+ * lcores of a socket with ports alternate between rx and tx, the others
+ * take the role with fewer lcores, since the default lcores come first
+ * a single free lcore per socket could leave no tx lcore at all, then
+ * the last rx lcore is turned into one */
+static void
+plan_roles(void)
+{
+    unsigned nb_ports_socket[RTE_MAX_NUMA_NODES];
+    unsigned turn[RTE_MAX_NUMA_NODES];
+    unsigned nb_rx = 0, nb_tx = 0;
+    struct dp_lcore_params *lp;
+    uint8_t port_id;
+    uint32_t i;
+
+    memset(nb_ports_socket, 0, sizeof(nb_ports_socket));
+    memset(turn, 0, sizeof(turn));
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        nb_ports_socket[dp_plan.port_socket[port_id]]++;
+    }
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (lp->type != DP_LCORE_TYPE_UNUSED || nb_ports_socket[lcore_socket(lp)] == 0) {
+            continue;
+        }
+        if (turn[lcore_socket(lp)]++ % 2 == 0) {
+            lp->type = DP_LCORE_TYPE_DATA_RX;
+            nb_rx++;
+        } else {
+            lp->type = DP_LCORE_TYPE_DATA_TX;
+            nb_tx++;
+        }
+    }
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (lp->type != DP_LCORE_TYPE_UNUSED) {
+            continue;
+        }
+        if (nb_rx <= nb_tx) {
+            lp->type = DP_LCORE_TYPE_DATA_RX;
+            nb_rx++;
+        } else {
+            lp->type = DP_LCORE_TYPE_DATA_TX;
+            nb_tx++;
+        }
+    }
+
+    for (i = dp.nb_lcores; nb_tx == 0 && i-- > 0; ) {
+        if (dp.lcores[i].type == DP_LCORE_TYPE_DATA_RX) {
+            dp.lcores[i].type = DP_LCORE_TYPE_DATA_TX;
+            nb_tx++;
+        }
+    }
+}
+
+/* least loaded lcore of the type, on the given socket if possible */
+static int
+plan_lcore(enum dp_lcore_type type, unsigned socket)
+{
+    int best = -1, best_remote = -1;
+    struct dp_lcore_params *lp;
+    uint32_t i;
+
+    for (i = 0; i < dp.nb_lcores; i++) {
+        lp = &dp.lcores[i];
+        if (lp->type != type || lp->nb_ports >= DP_LCORE_PORT_MAX) {
+            continue;
+        }
+        if (lcore_socket(lp) == socket) {
+            if (best < 0 || lp->nb_ports < dp.lcores[best].nb_ports) {
+                best = i;
+            }
+        } else if (best_remote < 0 || lp->nb_ports < dp.lcores[best_remote].nb_ports) {
+            best_remote = i;
+        }
+    }
+
+    if (best < 0 && best_remote >= 0) {
+        DP_LOG_INFO("no %s lcore left on socket %u, using lcore %u on socket %u",
+                    type == DP_LCORE_TYPE_DATA_RX ? "rx" : "tx", socket,
+                    dp.lcores[best_remote].id, lcore_socket(&dp.lcores[best_remote]));
+        best = best_remote;
+    }
+
+    return best;
+}
+
+/* assigns roles to the free lcores and ports to the data lcores */
+int
+dp_plan_apply(void)
+{
+    struct dp_lcore_params *lp;
+    uint8_t port_id;
+    int idx;
+
+    DP_LOG_ENTRY();
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        dp_plan.port_socket[port_id] = DAQSWITCH_PORT_GET_NUMA(port_id);
+    }
+
+    plan_roles();
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        idx = plan_lcore(DP_LCORE_TYPE_DATA_RX, dp_plan.port_socket[port_id]);
+        if (idx < 0) {
+            DP_LOG_ERR_AND_RETURN("no data rx lcore left for port %u", port_id);
+        }
+        lp = &dp.lcores[idx];
+        dp_rx_port_conf_init(&lp->rx.port_list[lp->nb_ports++], port_id);
+        dp_plan.rx_lcore[port_id] = idx;
+
+        idx = plan_lcore(DP_LCORE_TYPE_DATA_TX, dp_plan.port_socket[port_id]);
+        if (idx < 0) {
+            DP_LOG_ERR_AND_RETURN("no data tx lcore left for port %u", port_id);
+        }
+        lp = &dp.lcores[idx];
+        dp_tx_port_conf_init(&lp->tx.port_list[lp->nb_ports++], port_id);
+        dp_plan.tx_lcore[port_id] = idx;
+    }
+
+    dp_plan_report();
+
+    DP_LOG_EXIT();
+
+    return DP_SUCCESS;
+
+error:
+    return DP_ERR;
+}
+
+/* lanes are written by the rx lcore of the input port */
+unsigned
+dp_plan_lane_socket(uint8_t in_port_id)
+{
+    return lcore_socket(&dp.lcores[dp_plan.rx_lcore[in_port_id]]);
+}
+
+/* placement and the expected socket crossings
+ * a port served by an lcore of another socket crosses on every
+ * descriptor and mbuf header, this is avoidable with more lcores,
+ * traffic between ports of different sockets crosses once on its
+ * way from the rx to the tx lcore whatever the placement */
+void
+dp_plan_report(void)
+{
+    unsigned rx_socket, tx_socket, remote = 0, pairs = 0, pairs_remote = 0;
+    uint8_t port_id, out_port_id;
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        rx_socket = lcore_socket(&dp.lcores[dp_plan.rx_lcore[port_id]]);
+        tx_socket = lcore_socket(&dp.lcores[dp_plan.tx_lcore[port_id]]);
+
+        DP_LOG_INFO("port %u socket %u: rx lcore %u socket %u%s, tx lcore %u socket %u%s",
+                    port_id, dp_plan.port_socket[port_id],
+                    dp.lcores[dp_plan.rx_lcore[port_id]].id, rx_socket,
+                    rx_socket != dp_plan.port_socket[port_id] ? " (remote)" : "",
+                    dp.lcores[dp_plan.tx_lcore[port_id]].id, tx_socket,
+                    tx_socket != dp_plan.port_socket[port_id] ? " (remote)" : "");
+
+        remote += (rx_socket != dp_plan.port_socket[port_id]) +
+                  (tx_socket != dp_plan.port_socket[port_id]);
+
+        DAQSWITCH_PORT_FOREACH(out_port_id) {
+            if (out_port_id == port_id) {
+                continue;
+            }
+            pairs++;
+            if (dp_plan.port_socket[out_port_id] != dp_plan.port_socket[port_id]) {
+                pairs_remote++;
+            }
+        }
+    }
+
+    DP_LOG_INFO("socket crossings: %u port roles served from a remote socket (avoidable), "
+                "%u of %u port pairs across sockets (inherent to the traffic)",
+                remote, pairs_remote, pairs);
+}
+#endif
@@ -0,0 +1,44 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_PLAN_H
+#define DP_PLAN_H
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+
+#include "../../daqswitch/daqswitch.h"
+
+/* numa placement of the data lcores and the voq lanes
+ *
+ * the data lcores of each socket with ports are split into rx and tx
+ * lcores, each port gets the least loaded rx and tx lcore on its own
+ * socket, a lane is allocated on the socket of its producer, the rx lcore
+ * of the input port, the tx lcore of the output port pulls the slots
+ * across once per burst, together with the mbufs it reads anyway
+ * the plan is computed once before the voqs are created, a port falls
+ * back to an lcore on another socket only if its socket has no lcore of
+ * the role, which the report at init points out */
+struct dp_plan {
+    unsigned port_socket[DAQSWITCH_MAX_PORTS];
+    /* index in dp.lcores of the lcores first serving the port */
+    uint32_t rx_lcore[DAQSWITCH_MAX_PORTS];
+    uint32_t tx_lcore[DAQSWITCH_MAX_PORTS];
+};
+
+extern struct dp_plan dp_plan;
+
+int dp_plan_apply(void);
+unsigned dp_plan_lane_socket(uint8_t in_port_id);
+void dp_plan_report(void);
+
+#endif /* DP_PLAN_H */
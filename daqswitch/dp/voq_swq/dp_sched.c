@@ -0,0 +1,167 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_malloc.h>
+#include <rte_ethdev.h>
+#include <rte_sched.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch.h"
+#include "../../daqswitch/daqswitch_port.h"
+
+#include "dp_voq_swq.h"
+#include "dp_sched.h"
+
+#if !defined(DAQ_DATA_FLOWS_DISABLE) && defined(DP_EGRESS_SCHED)
+struct dp_sched *dp_scheds[DAQSWITCH_MAX_PORTS][2];
+
+static const uint32_t tc_rate_pct[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE] = DP_SCHED_TC_RATE_PCT;
+
+static uint32_t
+port_rate(uint8_t port_id)
+{
+    struct rte_eth_link link;
+
+    if (DP_SCHED_PORT_RATE) {
+        return DP_SCHED_PORT_RATE;
+    }
+
+    memset(&link, 0, sizeof(link));
+    rte_eth_link_get_nowait(port_id, &link);
+    if (link.link_speed == 0) {
+        DP_LOG_INFO("warning: port %u link down, scheduling at %u bytes/s",
+                    port_id, DP_SCHED_PORT_RATE_DEFAULT);
+        return DP_SCHED_PORT_RATE_DEFAULT;
+    }
+
+    /* mbps to bytes/s, rte_sched rates are 32 bits */
+    return RTE_MIN((uint64_t) link.link_speed * 1000000 / 8, (uint64_t) UINT32_MAX);
+}
+
+/* a port with DP_SCHED_SUBPORTS subports, a pipe per data voq
+ * and a single pipe profile shared by all of them */
+static struct rte_sched_port *
+sched_port_create(uint8_t port_id, unsigned part)
+{
+    struct rte_sched_port_params port_params;
+    struct rte_sched_subport_params subport_params;
+    struct rte_sched_pipe_params pipe_params;
+    struct rte_sched_port *port;
+    uint32_t rate = port_rate(port_id);
+    uint32_t subport, pipe;
+    unsigned tc, q;
+    char name[64];
+
+    memset(&pipe_params, 0, sizeof(pipe_params));
+    pipe_params.tb_rate = (uint64_t) rate * DP_SCHED_PIPE_RATE_PCT / 100;
+    pipe_params.tb_size = DP_SCHED_TB_SIZE;
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++) {
+        pipe_params.tc_rate[tc] = (uint64_t) pipe_params.tb_rate * tc_rate_pct[tc] / 100;
+    }
+    pipe_params.tc_period = DP_SCHED_TC_PERIOD;
+    for (q = 0; q < RTE_SCHED_QUEUES_PER_PIPE; q++) {
+        pipe_params.wrr_weights[q] = DP_SCHED_QUEUE_WEIGHT;
+    }
+
+    snprintf(name, sizeof(name), "dp_sched_p%u_%u", port_id, part);
+    memset(&port_params, 0, sizeof(port_params));
+    port_params.name = name;
+    port_params.socket = DAQSWITCH_PORT_GET_NUMA(port_id);
+    port_params.rate = rate;
+    port_params.mtu = daqswitch_get_max_frame_len();
+    port_params.frame_overhead = RTE_SCHED_FRAME_OVERHEAD_DEFAULT;
+    port_params.n_subports_per_port = DP_SCHED_SUBPORTS;
+    port_params.n_pipes_per_subport = DP_PORT_MAX_DATA_FLOWS;
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++) {
+        port_params.qsize[tc] = DP_SCHED_QSIZE;
+    }
+    port_params.pipe_profiles = &pipe_params;
+    port_params.n_pipe_profiles = 1;
+#ifdef RTE_SCHED_RED
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++) {
+        for (q = 0; q < e_RTE_METER_COLORS; q++) {
+            port_params.red_params[tc][q].min_th = DP_SCHED_RED_MIN_TH;
+            port_params.red_params[tc][q].max_th = DP_SCHED_RED_MAX_TH;
+            port_params.red_params[tc][q].maxp_inv = DP_SCHED_RED_MAXP_INV;
+            port_params.red_params[tc][q].wq_log2 = DP_SCHED_RED_WQ_LOG2;
+        }
+    }
+#endif
+
+    port = rte_sched_port_config(&port_params);
+    if (port == NULL) {
+        return NULL;
+    }
+
+    memset(&subport_params, 0, sizeof(subport_params));
+    subport_params.tb_rate = (uint64_t) rate * DP_SCHED_SUBPORT_RATE_PCT / 100;
+    subport_params.tb_size = DP_SCHED_TB_SIZE;
+    for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++) {
+        subport_params.tc_rate[tc] = subport_params.tb_rate;
+    }
+    subport_params.tc_period = DP_SCHED_TC_PERIOD;
+
+    for (subport = 0; subport < DP_SCHED_SUBPORTS; subport++) {
+        if (rte_sched_subport_config(port, subport, &subport_params) != 0) {
+            return NULL;
+        }
+        for (pipe = 0; pipe < DP_PORT_MAX_DATA_FLOWS; pipe++) {
+            if (rte_sched_pipe_config(port, subport, pipe, 0) != 0) {
+                return NULL;
+            }
+        }
+    }
+
+    DP_LOG_INFO("port %u part %u: scheduler at %u bytes/s, %u subports, %u pipes",
+                port_id, part, rate, DP_SCHED_SUBPORTS, DP_PORT_MAX_DATA_FLOWS);
+
+    return port;
+}
+
+int
+dp_sched_init(void)
+{
+    struct dp_sched *s;
+    unsigned part;
+    uint8_t i;
+    char name[64];
+
+    DP_LOG_ENTRY();
+
+    DAQSWITCH_PORT_FOREACH(i) {
+        for (part = 0; part < 2; part++) {
+            snprintf(name, sizeof(name), "dp_sched_p%u_%u", i, part);
+            s = rte_zmalloc_socket(name, sizeof(*s), CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+            if (s == NULL) {
+                DP_LOG_ERR_AND_RETURN("port %u: cannot allocate the scheduler", i);
+            }
+
+            s->port = sched_port_create(i, part);
+            if (s->port == NULL) {
+                DP_LOG_ERR_AND_RETURN("port %u: cannot configure the scheduler", i);
+            }
+
+            dp_scheds[i][part] = s;
+        }
+    }
+
+    DP_LOG_EXIT();
+
+    return DP_SUCCESS;
+
+error:
+    return DP_ERR;
+}
+#endif
@@ -0,0 +1,106 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_SCHED_H
+#define DP_SCHED_H
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+#include <rte_sched.h>
+
+#include "../../daqswitch/daqswitch.h"
+
+#include "dp_voq_swq.h"
+
+/* hierarchical egress scheduling with rte_sched, built with DP_EGRESS_SCHED
+ *
+ * the tx lcore moves the packets of the data voqs of a port into an
+ * rte_sched port and sends what the scheduler dequeues, instead of
+ * serving the voqs itself, rte_sched is not thread safe, so both sides
+ * run on the tx lcore and the voq lanes stay the hand-over from the rx
+ * lcores, the hierarchy is
+ *   subport  group of ros input ports, input port % DP_SCHED_SUBPORTS
+ *   pipe     data voq, i.e. a dcm on a dcm port
+ *   class    traffic class of the voq, see dp_tc.h, strict priority
+ *   queue    input port within the group, weighted round robin
+ * a lane is moved into the scheduler while its queue has room only,
+ * so the scheduler drops nothing but with red, and the voqs keep their
+ * back-pressure, admission control, event ordering and the class weights
+ * are not applied, their tunables are not offered in this mode
+ * a split port has a scheduler per part, each owned by one lcore */
+#ifndef DP_SCHED_SUBPORTS
+    #define DP_SCHED_SUBPORTS                                                             8
+#endif
+/* packets per scheduler queue, a power of 2 */
+#ifndef DP_SCHED_QSIZE
+    #define DP_SCHED_QSIZE                                                               64 /* pkts */
+#endif
+/* port rate, 0 for the link speed at init */
+#ifndef DP_SCHED_PORT_RATE
+    #define DP_SCHED_PORT_RATE                                                            0 /* bytes/s */
+#endif
+/* rate of a link that is down at init */
+#define DP_SCHED_PORT_RATE_DEFAULT                                              1250000000 /* bytes/s */
+/* share of the port rate a single subport and pipe may use */
+#ifndef DP_SCHED_SUBPORT_RATE_PCT
+    #define DP_SCHED_SUBPORT_RATE_PCT                                                   100 /* % */
+#endif
+#ifndef DP_SCHED_PIPE_RATE_PCT
+    #define DP_SCHED_PIPE_RATE_PCT                                                      100 /* % */
+#endif
+/* share of the pipe rate of each traffic class */
+#ifndef DP_SCHED_TC_RATE_PCT
+    #define DP_SCHED_TC_RATE_PCT                                           {100, 100, 100, 100}
+#endif
+/* weight of the queue of each input port within its group */
+#ifndef DP_SCHED_QUEUE_WEIGHT
+    #define DP_SCHED_QUEUE_WEIGHT                                                         1
+#endif
+#define DP_SCHED_TB_SIZE                                                            1000000 /* bytes */
+#define DP_SCHED_TC_PERIOD                                                               10 /* ms */
+/* red thresholds of every class and color, used if dpdk is built with RTE_SCHED_RED */
+#ifndef DP_SCHED_RED_MIN_TH
+    #define DP_SCHED_RED_MIN_TH                                        (DP_SCHED_QSIZE / 2) /* pkts */
+#endif
+#ifndef DP_SCHED_RED_MAX_TH
+    #define DP_SCHED_RED_MAX_TH                                            (DP_SCHED_QSIZE) /* pkts */
+#endif
+#define DP_SCHED_RED_MAXP_INV                                                            10
+#define DP_SCHED_RED_WQ_LOG2                                                              9
+
+#define DP_SCHED_SUBPORT(lane)                                     ((lane) % DP_SCHED_SUBPORTS)
+#define DP_SCHED_QUEUE(lane)    ((lane) / DP_SCHED_SUBPORTS % RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS)
+/* index of the queue of a subport within a pipe and class */
+#define DP_SCHED_SLOTS                        (DP_SCHED_SUBPORTS * RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS)
+#define DP_SCHED_SLOT(subport, queue)                     ((queue) * DP_SCHED_SUBPORTS + (subport))
+
+struct dp_sched {
+    struct rte_sched_port *port;
+    /* packets in the scheduler, per queue slot and voq (pipe) */
+    uint16_t queued[DP_SCHED_SLOTS][DP_PORT_MAX_DATA_FLOWS];
+    uint32_t nb_queued;
+    /* packets dropped by red */
+    uint64_t dropped;
+} __rte_cache_aligned;
+
+/* a scheduler per port and part, see lcore_data_tx_port_conf */
+extern struct dp_sched *dp_scheds[DAQSWITCH_MAX_PORTS][2];
+
+static inline struct dp_sched *
+dp_sched_get(uint8_t port_id, uint16_t queue_base)
+{
+    return dp_scheds[port_id][queue_base != DP_PORT_TXQ_ID_TC(0)];
+}
+
+int dp_sched_init(void);
+
+#endif /* DP_SCHED_H */
@@ -0,0 +1,203 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
+#include "../../stats/stats.h"
+#include "../include/dp.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tunables.h"
+#include "dp_tc.h"
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+const char *dp_tc_names[DP_TC_MAX] = {
+    [DP_TC_CTRL] = "ctrl",
+    [DP_TC_REQ]  = "req",
+    [DP_TC_DATA] = "data",
+    [DP_TC_BULK] = "bulk",
+};
+
+static const char *kind_names[] = {
+    [DP_TC_KIND_ANY]  = "any",
+    [DP_TC_KIND_REQ]  = "req",
+    [DP_TC_KIND_DATA] = "data",
+};
+
+/* checked after the configured ones, a voq matching none is bulk */
+static const struct dp_tc_rule default_rules[] = {
+    /* network control, cs6 and cs7 */
+    { DP_TC_KIND_ANY,  48, 63, 0, UINT16_MAX, DP_TC_CTRL },
+    { DP_TC_KIND_REQ,   0, 63, 0, UINT16_MAX, DP_TC_REQ },
+    { DP_TC_KIND_DATA,  0, 63, 0, UINT16_MAX, DP_TC_DATA },
+};
+
+/* appended by the command line, read by the default lcores */
+static struct dp_tc_rule rules[DP_TC_RULES_MAX];
+static volatile uint32_t nb_rules;
+
+static inline int
+rule_match(const struct dp_tc_rule *r, uint8_t kind, uint16_t ros_port, uint8_t dscp)
+{
+    return (r->kind == DP_TC_KIND_ANY || r->kind == kind) &&
+           dscp >= r->dscp_min && dscp <= r->dscp_max &&
+           ros_port >= r->ros_port_min && ros_port <= r->ros_port_max;
+}
+
+uint8_t
+dp_tc_classify(uint8_t kind, uint16_t ros_port, uint8_t dscp)
+{
+    uint32_t i, n = nb_rules;
+
+    for (i = 0; i < n; i++) {
+        if (rule_match(&rules[i], kind, ros_port, dscp)) {
+            return rules[i].tc;
+        }
+    }
+
+    for (i = 0; i < RTE_DIM(default_rules); i++) {
+        if (rule_match(&default_rules[i], kind, ros_port, dscp)) {
+            return default_rules[i].tc;
+        }
+    }
+
+    return DP_TC_BULK;
+}
+
+int
+dp_tc_rule_add(const struct dp_tc_rule *rule)
+{
+    if (nb_rules == DP_TC_RULES_MAX) {
+        DP_LOG_ERR_AND_RETURN("traffic class rule table full (%u rules)", DP_TC_RULES_MAX);
+    }
+
+    if (rule->tc >= DP_TC_MAX || rule->kind >= RTE_DIM(kind_names) ||
+        rule->dscp_min > rule->dscp_max || rule->dscp_max > 63 ||
+        rule->ros_port_min > rule->ros_port_max) {
+        DP_LOG_ERR_AND_RETURN("invalid traffic class rule");
+    }
+
+    /* the default lcores see the rule once it is complete */
+    rules[nb_rules] = *rule;
+    rte_compiler_barrier();
+    nb_rules++;
+
+    return DP_SUCCESS;
+
+error:
+    return DP_ERR;
+}
+
+int
+dp_add_tc_rule(const char *kind, uint8_t dscp_min, uint8_t dscp_max,
+               uint16_t ros_port_min, uint16_t ros_port_max, uint8_t tc)
+{
+    struct dp_tc_rule rule;
+    uint8_t i;
+
+    memset(&rule, 0, sizeof(rule));
+    rule.kind = RTE_DIM(kind_names);
+    for (i = 0; i < RTE_DIM(kind_names); i++) {
+        if (strcmp(kind, kind_names[i]) == 0) {
+            rule.kind = i;
+        }
+    }
+    rule.dscp_min = dscp_min;
+    rule.dscp_max = dscp_max;
+    rule.ros_port_min = ros_port_min;
+    rule.ros_port_max = ros_port_max;
+    rule.tc = tc;
+
+    return dp_tc_rule_add(&rule);
+}
+
+static void
+rule_print(const struct dp_tc_rule *r, const char *origin)
+{
+    printf("| %-7s | %4s | %2u-%-2u | %5u-%-5u | %-5s |\n", origin, kind_names[r->kind],
+           r->dscp_min, r->dscp_max, r->ros_port_min, r->ros_port_max, dp_tc_names[r->tc]);
+}
+
+void
+dp_dump_tc(void)
+{
+    uint64_t packets, voqs;
+    uint32_t i, weight;
+    uint8_t port_id, tc;
+
+    printf("+-------+------+--------+---------+\n");
+    printf("| Class | Name | Weight | Txq     |\n");
+    printf("+-------+------+--------+---------+\n");
+    for (tc = 0; tc < DP_TC_MAX; tc++) {
+        printf("| %5u | %4s | ", tc, dp_tc_names[tc]);
+        weight = dp_tunables.t.tc_weight[tc];
+#ifdef DP_EGRESS_SCHED
+        /* rte_sched serves the classes in strict priority */
+        weight = 0;
+#endif
+        if (weight == 0) {
+            printf("strict |");
+        } else {
+            printf("%6u |", weight);
+        }
+        printf(" %3u/%-3u |\n", DP_PORT_TXQ_ID_TC(tc), DP_PORT_TXQ_ID_TC_SPLIT(tc));
+    }
+    printf("+-------+------+--------+---------+\n");
+
+    /* packets of both halves of a split port */
+    printf("+------+-------+------+----------------------+\n");
+    printf("| Port | Class | Voqs | Tx packets           |\n");
+    printf("+------+-------+------+----------------------+\n");
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (tc = 0; tc < DP_TC_MAX; tc++) {
+            voqs = dp.tc_flows[port_id][tc];
+            packets = daqswitch_tx_queue_stats[port_id][DP_PORT_TXQ_ID_TC(tc)].total_packets +
+                      daqswitch_tx_queue_stats[port_id][DP_PORT_TXQ_ID_TC_SPLIT(tc)].total_packets;
+            printf("| %4u | %5s | %4u | %20" PRIu64 " |\n", port_id, dp_tc_names[tc],
+                   __builtin_popcountll(voqs), packets);
+        }
+    }
+    printf("+------+-------+------+----------------------+\n");
+
+    printf("+---------+------+-------+-------------+-------+\n");
+    printf("| Rule    | Kind | Dscp  | Ros port    | Class |\n");
+    printf("+---------+------+-------+-------------+-------+\n");
+    for (i = 0; i < nb_rules; i++) {
+        rule_print(&rules[i], "config");
+    }
+    for (i = 0; i < RTE_DIM(default_rules); i++) {
+        rule_print(&default_rules[i], "default");
+    }
+    printf("+---------+------+-------+-------------+-------+\n");
+}
+#else
+int
+dp_add_tc_rule(__attribute__((unused)) const char *kind,
+               __attribute__((unused)) uint8_t dscp_min,
+               __attribute__((unused)) uint8_t dscp_max,
+               __attribute__((unused)) uint16_t ros_port_min,
+               __attribute__((unused)) uint16_t ros_port_max,
+               __attribute__((unused)) uint8_t tc)
+{
+    printf("traffic classes need the data flows\n");
+    return DP_ERR;
+}
+
+void
+dp_dump_tc(void)
+{
+    printf("traffic classes need the data flows\n");
+}
+#endif
@@ -0,0 +1,71 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_TC_H
+#define DP_TC_H
+
+#include <stdint.h>
+
+/* traffic classes of the data voqs
+ *
+ * a voq gets its class once, when the default lcore creates it, from the
+ * first rule matching the request which triggered it, every class has its
+ * own nic tx queue, so a burst of one class never waits behind the
+ * descriptors of another one on the nic
+ * the tx lcore serves the classes of a port in order every round, a
+ * strict class (weight 0) is emptied up to DP_TC_STRICT_BURSTS bursts per
+ * voq, the weighted ones get weight bursts each, so they share what is
+ * left in proportion to their weights when all of them are backlogged */
+#define DP_TC_MAX                                                                         4
+#define DP_TC_RULES_MAX                                                                  16
+#define DP_TC_STRICT_BURSTS                                                               4
+
+enum dp_tc {
+    DP_TC_CTRL = 0,
+    DP_TC_REQ,
+    DP_TC_DATA,
+    DP_TC_BULK,
+};
+
+/* default weights, runtime tunables, see dp_tunables.h */
+#ifndef DP_TC_WEIGHT_DATA
+    #define DP_TC_WEIGHT_DATA                                                             4 /* bursts */
+#endif
+#ifndef DP_TC_WEIGHT_BULK
+    #define DP_TC_WEIGHT_BULK                                                             1 /* bursts */
+#endif
+
+/* voq a rule applies to */
+enum dp_tc_kind {
+    DP_TC_KIND_ANY = 0,
+    /* dcm->ros, fragment requests */
+    DP_TC_KIND_REQ,
+    /* ros->dcm, fragment data */
+    DP_TC_KIND_DATA,
+};
+
+/* ranges are inclusive, ros_port is the tcp port on the ros side
+ * in host order and dscp the one of the request */
+struct dp_tc_rule {
+    uint8_t kind;
+    uint8_t dscp_min;
+    uint8_t dscp_max;
+    uint16_t ros_port_min;
+    uint16_t ros_port_max;
+    uint8_t tc;
+};
+
+extern const char *dp_tc_names[DP_TC_MAX];
+
+int dp_tc_rule_add(const struct dp_tc_rule *rule);
+uint8_t dp_tc_classify(uint8_t kind, uint16_t ros_port, uint8_t dscp);
+
+#endif /* DP_TC_H */
@@ -0,0 +1,243 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+
+#include <rte_malloc.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_byteorder.h>
+
+#include "../../common/common.h"
+#include "../../daqswitch/daqswitch_port.h"
+#include "../include/dp.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tcpmon.h"
+
+#ifdef DP_TCP_MONITOR
+
+#define TCP_FLAG_SYN                                                                   0x02
+#define TCP_FLAG_RST                                                                   0x04
+#define TCP_FLAG_FIN                                                                   0x01
+#define TCP_FLAG_ACK                                                                   0x10
+
+struct tcpmon_counters {
+    uint64_t segments;
+    /* segments ending at or before the highest sequence number seen,
+     * retransmissions or reordered segments */
+    uint64_t late;
+    /* segments starting after the next expected sequence number */
+    uint64_t gaps;
+    uint64_t dup_acks;
+};
+
+/* a direction of a tcp connection, tx lcore of the port only */
+struct tcpmon_conn {
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t valid;
+    uint8_t flow_id;
+
+    uint32_t next_seq;
+    uint32_t last_ack;
+    uint16_t last_win;
+
+    struct tcpmon_counters cnt;
+};
+
+static struct tcpmon_conn *tcpmon_conns[DAQSWITCH_MAX_PORTS];
+
+/* per voq, tx lcore of the port only */
+static struct tcpmon_counters tcpmon_voq[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
+
+static inline void
+tcpmon_pkt(uint8_t port_id, uint32_t flow_id, struct rte_mbuf *pkt)
+{
+    struct tcpmon_counters *voq_cnt = &tcpmon_voq[port_id][flow_id];
+    struct ipv4_hdr *ip_hdr;
+    struct tcp_hdr *tcp_hdr;
+    struct tcpmon_conn *conn;
+    uint32_t len, seq, ack, h;
+    uint16_t win;
+
+    /* the payload length is clamped to the mbuf chain */
+    if (dp_pkt_tcp_payload(pkt, &ip_hdr, &tcp_hdr, &len) == NULL) {
+        return;
+    }
+
+    h = dp_conn_hash(ip_hdr, tcp_hdr);
+    if ((h >> 16) & (DP_TCP_MONITOR_SAMPLE - 1)) {
+        return;
+    }
+
+    seq = rte_be_to_cpu_32(tcp_hdr->sent_seq);
+    ack = rte_be_to_cpu_32(tcp_hdr->recv_ack);
+    win = rte_be_to_cpu_16(tcp_hdr->rx_win);
+
+    conn = &tcpmon_conns[port_id][h & (DP_TCP_MONITOR_CONN_TABLE_SIZE - 1)];
+    if (!conn->valid || conn->sip != ip_hdr->src_addr || conn->dip != ip_hdr->dst_addr ||
+        conn->sport != tcp_hdr->src_port || conn->dport != tcp_hdr->dst_port ||
+        (tcp_hdr->tcp_flags & TCP_FLAG_SYN)) {
+        /* new connection or a collision, the older one is forgotten */
+        memset(conn, 0, sizeof(*conn));
+        conn->sip = ip_hdr->src_addr;
+        conn->dip = ip_hdr->dst_addr;
+        conn->sport = tcp_hdr->src_port;
+        conn->dport = tcp_hdr->dst_port;
+        conn->flow_id = flow_id;
+        conn->next_seq = seq + len;
+        conn->last_ack = ack;
+        conn->last_win = win;
+        conn->valid = 1;
+        conn->cnt.segments++;
+        voq_cnt->segments++;
+        return;
+    }
+
+    conn->cnt.segments++;
+    voq_cnt->segments++;
+
+    if (len > 0) {
+        if ((int32_t) (seq + len - conn->next_seq) <= 0) {
+            conn->cnt.late++;
+            voq_cnt->late++;
+        } else {
+            if ((int32_t) (seq - conn->next_seq) > 0) {
+                conn->cnt.gaps++;
+                voq_cnt->gaps++;
+            }
+            conn->next_seq = seq + len;
+        }
+        conn->last_ack = ack;
+        conn->last_win = win;
+        return;
+    }
+
+    /* pure ack, the same ack and window again is a duplicate */
+    if ((tcp_hdr->tcp_flags & (TCP_FLAG_SYN | TCP_FLAG_FIN | TCP_FLAG_RST | TCP_FLAG_ACK)) == TCP_FLAG_ACK &&
+        ack == conn->last_ack && win == conn->last_win) {
+        conn->cnt.dup_acks++;
+        voq_cnt->dup_acks++;
+    }
+    conn->last_ack = ack;
+    conn->last_win = win;
+}
+
+void
+dp_tcpmon_init(void)
+{
+    uint8_t i;
+    char s[64];
+
+    DP_LOG_ENTRY();
+
+    DAQSWITCH_PORT_FOREACH(i) {
+        snprintf(s, sizeof(s), "dp_tcpmon_conns_p%d", i);
+        tcpmon_conns[i] = rte_zmalloc_socket(s, DP_TCP_MONITOR_CONN_TABLE_SIZE * sizeof(struct tcpmon_conn),
+                                             CACHE_LINE_SIZE, DAQSWITCH_PORT_GET_NUMA(i));
+        RTE_VERIFY(tcpmon_conns[i]);
+    }
+
+    DP_LOG_EXIT();
+}
+
+/* called by the tx lcore of port_id for packets of voq flow_id
+ * just accepted by the nic */
+void
+dp_tcpmon_tx(uint8_t port_id, uint32_t flow_id,
+             struct rte_mbuf **pkts, uint16_t n)
+{
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        tcpmon_pkt(port_id, flow_id, pkts[i]);
+    }
+}
+
+#endif /* DP_TCP_MONITOR */
+
+void
+dp_dump_tcp(void)
+{
+#ifdef DP_TCP_MONITOR
+    struct tcpmon_counters *cnt;
+    struct tcpmon_conn *conn;
+    uint8_t port_id;
+    uint32_t i;
+
+    printf("sampling 1 in %d connections\n", DP_TCP_MONITOR_SAMPLE);
+    printf("+------+-------+----------------+-----------------+--------------+--------------+--------------+\n");
+    printf("| Port | Queue | Destination IP | Segments        | Late         | Gaps         | Dup ACKs     |\n");
+    printf("+------+-------+----------------+-----------------+--------------+--------------+--------------+\n");
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
+            cnt = &tcpmon_voq[port_id][i];
+            if (!dp.flows[port_id][i].active || cnt->segments == 0) {
+                continue;
+            }
+
+            printf("| %4d | %5d |     0x%08x | %15" PRIu64 " | %12" PRIu64 " | %12" PRIu64 " | %12" PRIu64 " |\n",
+                   port_id, i, rte_be_to_cpu_32(dp.flows[port_id][i].dest_ip),
+                   cnt->segments, cnt->late, cnt->gaps, cnt->dup_acks);
+        }
+    }
+
+    printf("+------+-------+----------------+-----------------+--------------+--------------+--------------+\n");
+
+    /* connections with anything to report */
+    printf("+------+-------+---------------------------------------------+--------------+--------------+--------------+\n");
+    printf("| Port | Queue | Connection                                  | Late         | Gaps         | Dup ACKs     |\n");
+    printf("+------+-------+---------------------------------------------+--------------+--------------+--------------+\n");
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (i = 0; i < DP_TCP_MONITOR_CONN_TABLE_SIZE; i++) {
+            conn = &tcpmon_conns[port_id][i];
+            if (!conn->valid || (conn->cnt.late | conn->cnt.gaps | conn->cnt.dup_acks) == 0) {
+                continue;
+            }
+
+            printf("| %4d | %5d | 0x%08x:%-5d -> 0x%08x:%-5d       | %12" PRIu64 " | %12" PRIu64 " | %12" PRIu64 " |\n",
+                   port_id, conn->flow_id,
+                   rte_be_to_cpu_32(conn->sip), rte_be_to_cpu_16(conn->sport),
+                   rte_be_to_cpu_32(conn->dip), rte_be_to_cpu_16(conn->dport),
+                   conn->cnt.late, conn->cnt.gaps, conn->cnt.dup_acks);
+        }
+    }
+
+    printf("+------+-------+---------------------------------------------+--------------+--------------+--------------+\n");
+#else
+    printf("tcp monitor disabled at build time\n");
+#endif
+}
+
+void
+dp_reset_tcp(void)
+{
+#ifdef DP_TCP_MONITOR
+    uint8_t port_id;
+    uint32_t i;
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        memset(tcpmon_voq[port_id], 0, sizeof(tcpmon_voq[port_id]));
+        for (i = 0; i < DP_TCP_MONITOR_CONN_TABLE_SIZE; i++) {
+            memset(&tcpmon_conns[port_id][i].cnt, 0, sizeof(struct tcpmon_counters));
+        }
+    }
+#endif
+}
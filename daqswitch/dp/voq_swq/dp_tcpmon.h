@@ -0,0 +1,43 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_TCPMON_H
+#define DP_TCPMON_H
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+/* passive tcp health monitor of the data flows
+ * segments are inspected when handed to the nic by the data tx lcores,
+ * a lossless switch should show no late segments and no duplicate acks */
+#ifdef DP_TCP_MONITOR
+
+#ifdef DAQ_DATA_FLOWS_DISABLE
+#error "DP_TCP_MONITOR needs the data flows"
+#endif
+
+/* one in DP_TCP_MONITOR_SAMPLE connections is followed, power of 2 */
+#ifndef DP_TCP_MONITOR_SAMPLE
+    #define DP_TCP_MONITOR_SAMPLE                                                         1
+#endif
+/* tcp connections tracked per output port */
+#ifndef DP_TCP_MONITOR_CONN_TABLE_SIZE
+    #define DP_TCP_MONITOR_CONN_TABLE_SIZE                                             4096
+#endif
+
+void dp_tcpmon_init(void);
+void dp_tcpmon_tx(uint8_t port_id, uint32_t flow_id,
+                  struct rte_mbuf **pkts, uint16_t n);
+
+#endif /* DP_TCP_MONITOR */
+
+#endif /* DP_TCPMON_H */
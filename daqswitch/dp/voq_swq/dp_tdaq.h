@@ -0,0 +1,236 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_TDAQ_H
+#define DP_TDAQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_byteorder.h>
+
+#include "../../pipeline/pipeline.h"
+
+#include "dp_voq_swq.h"
+
+/* following of the atlas tdaq messages of the data flows, shared by the
+ * event latency (dp_event.c) and the event ordering (dp_order.c)
+ *
+ * fragment requests are remembered in a table per port, keyed by the
+ * dcm and ros addresses and the transaction id, the response stream of
+ * every ros->dcm connection is then followed message by message, in sync
+ * a response starts right after the previous one, after a gap in the
+ * sequence numbers the stream is taken up again at a segment starting
+ * with the header of a known request, a payload chained over several
+ * mbufs is followed to its end
+ * header fields are taken in host order, as the type id comparison does */
+
+/* a response starts with typeId, transactionId and size,
+ * the size counts the bytes following them */
+#define DP_TDAQ_RESP_HDR_SIZE                          (offsetof(struct tdaq_hdr, event_id))
+
+/* a request, written by a single lcore, the sequence number is odd
+ * while the entry is updated, so readers on other lcores check it twice
+ * transaction ids are small counters of each dcm, so a request is only
+ * matched on all of dcm, ros and transaction id */
+struct dp_tdaq_req {
+    volatile uint32_t seq;
+    volatile uint32_t transaction_id;
+    volatile uint32_t dcm_ip;
+    volatile uint32_t ros_ip;
+    volatile uint64_t val;
+};
+
+/* a response tcp connection, single lcore only */
+struct dp_tdaq_conn {
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sport;
+    uint16_t dport;
+    /* next expected sequence number */
+    uint32_t next_seq;
+    /* bytes left of the current response, 0 between responses */
+    uint32_t remaining;
+    /* set if the position in the message stream is unknown */
+    uint8_t lost;
+    /* value of the request the current response answers, 0 if not known */
+    uint64_t req;
+};
+
+/* called for every response of a known request ending within a packet */
+typedef void (*dp_tdaq_resp_end_t)(void *arg, uint64_t req);
+
+static inline uint32_t
+dp_tdaq_req_hash(uint32_t dcm_ip, uint32_t ros_ip, uint32_t transaction_id)
+{
+    return dp_hash64(((uint64_t) dcm_ip << 32 | ros_ip) + dp_hash64(transaction_id));
+}
+
+/* header of a fragment request packet, NULL if pkt is not one, read
+ * into buf if it straddles two mbufs */
+static inline const struct tdaq_hdr *
+dp_tdaq_req_hdr(struct rte_mbuf *pkt, struct ipv4_hdr **ip_hdr, struct tdaq_hdr *buf)
+{
+    struct tcp_hdr *tcp_hdr;
+    const struct tdaq_hdr *hdr;
+    uint8_t *payload;
+    uint32_t len;
+
+    payload = dp_pkt_tcp_payload(pkt, ip_hdr, &tcp_hdr, &len);
+    if (payload == NULL || len < sizeof(struct tdaq_hdr)) {
+        return NULL;
+    }
+
+    hdr = dp_pkt_read(pkt, payload - rte_pktmbuf_mtod(pkt, uint8_t *), sizeof(struct tdaq_hdr), buf);
+    if (hdr == NULL || hdr->typeId != TDAQ_TYPE_ID_FRAGMENT_REQUEST_MESSAGE) {
+        return NULL;
+    }
+
+    return hdr;
+}
+
+static inline void
+dp_tdaq_req_store(struct dp_tdaq_req *reqs, uint32_t size, uint32_t dcm_ip, uint32_t ros_ip,
+                  uint32_t transaction_id, uint64_t val)
+{
+    struct dp_tdaq_req *req = &reqs[dp_tdaq_req_hash(dcm_ip, ros_ip, transaction_id) & (size - 1)];
+
+    req->seq++;
+    rte_compiler_barrier();
+    req->dcm_ip = dcm_ip;
+    req->ros_ip = ros_ip;
+    req->transaction_id = transaction_id;
+    req->val = val;
+    rte_compiler_barrier();
+    req->seq++;
+}
+
+/* value stored for a request, 0 if not known */
+static inline uint64_t
+dp_tdaq_req_lookup(const struct dp_tdaq_req *reqs, uint32_t size, uint32_t dcm_ip,
+                   uint32_t ros_ip, uint32_t transaction_id)
+{
+    const struct dp_tdaq_req *req = &reqs[dp_tdaq_req_hash(dcm_ip, ros_ip, transaction_id) & (size - 1)];
+    uint32_t seq;
+    uint64_t val;
+    int match;
+
+    seq = req->seq;
+    rte_compiler_barrier();
+    match = req->dcm_ip == dcm_ip && req->ros_ip == ros_ip &&
+            req->transaction_id == transaction_id;
+    val = req->val;
+    rte_compiler_barrier();
+
+    if ((seq & 1) || !match || req->seq != seq) {
+        return 0;
+    }
+
+    return val;
+}
+
+/* follows the response stream of the ros->dcm connection of pkt, with
+ * the requests looked up in reqs, end is called for every response of a
+ * known request completed by the packet, returns the value of the request
+ * the first payload byte answers, 0 if not known */
+static inline __attribute__((always_inline)) uint64_t
+dp_tdaq_resp_follow(struct dp_tdaq_conn *conns, uint32_t conns_size,
+                    const struct dp_tdaq_req *reqs, uint32_t reqs_size,
+                    struct rte_mbuf *pkt, dp_tdaq_resp_end_t end, void *arg)
+{
+    struct ipv4_hdr *ip_hdr;
+    struct tcp_hdr *tcp_hdr;
+    const struct tdaq_hdr *hdr;
+    struct tdaq_hdr hdr_buf;
+    struct dp_tdaq_conn *conn;
+    uint8_t *payload;
+    uint32_t len, seq, base, off, n;
+    uint64_t req, first = 0;
+
+    payload = dp_pkt_tcp_payload(pkt, &ip_hdr, &tcp_hdr, &len);
+    if (payload == NULL || len == 0) {
+        return 0;
+    }
+
+    base = payload - rte_pktmbuf_mtod(pkt, uint8_t *);
+    conn = &conns[dp_conn_hash(ip_hdr, tcp_hdr) & (conns_size - 1)];
+    seq = rte_be_to_cpu_32(tcp_hdr->sent_seq);
+
+    if (conn->sip != ip_hdr->src_addr || conn->dip != ip_hdr->dst_addr ||
+        conn->sport != tcp_hdr->src_port || conn->dport != tcp_hdr->dst_port) {
+        /* new connection or a collision, the older one is forgotten */
+        conn->sip = ip_hdr->src_addr;
+        conn->dip = ip_hdr->dst_addr;
+        conn->sport = tcp_hdr->src_port;
+        conn->dport = tcp_hdr->dst_port;
+        conn->next_seq = seq;
+        conn->remaining = 0;
+        conn->lost = 1;
+    }
+
+    /* retransmission of data already followed, its position
+     * in the stream is not known any more */
+    if ((int32_t) (seq - conn->next_seq) < 0) {
+        return 0;
+    }
+
+    if (seq != conn->next_seq) {
+        conn->remaining = 0;
+        conn->lost = 1;
+    }
+    conn->next_seq = seq + len;
+
+    for (off = 0; off < len; off += n) {
+
+        if (conn->remaining == 0) {
+            /* header split over tcp segments, not followed */
+            hdr = NULL;
+            if (len - off >= DP_TDAQ_RESP_HDR_SIZE) {
+                hdr = dp_pkt_read(pkt, base + off, DP_TDAQ_RESP_HDR_SIZE, &hdr_buf);
+            }
+            if (hdr == NULL) {
+                conn->lost = 1;
+                return first;
+            }
+
+            req = dp_tdaq_req_lookup(reqs, reqs_size, ip_hdr->dst_addr, ip_hdr->src_addr,
+                                     hdr->transactionId);
+
+            /* out of sync anything may look like a header, only
+             * the one of a known request is trusted */
+            if (conn->lost && req == 0) {
+                return first;
+            }
+
+            conn->lost = 0;
+            conn->req = req;
+            conn->remaining = DP_TDAQ_RESP_HDR_SIZE + hdr->size;
+        }
+
+        if (off == 0) {
+            first = conn->req;
+        }
+
+        n = RTE_MIN(len - off, conn->remaining);
+        conn->remaining -= n;
+
+        if (conn->remaining == 0 && conn->req && end != NULL) {
+            end(arg, conn->req);
+        }
+    }
+
+    return first;
+}
+
+#endif /* DP_TDAQ_H */
@@ -0,0 +1,169 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../../common/common.h"
+#include "../include/dp.h"
+
+#include "dp_voq_swq.h"
+#include "dp_tunables.h"
+
+struct dp_tunables_shared dp_tunables;
+
+/* bounds of a tunable, max 0 means the lane size */
+struct dp_tunable_desc {
+    const char *name;
+    size_t offset;
+    uint32_t min;
+    uint32_t max;
+    const char *unit;
+};
+
+#define DP_TUNABLE(field, min, max, unit) \
+    { #field, offsetof(struct dp_tunables, field), min, max, unit }
+#define DP_TUNABLE_TC(name, tc) \
+    { "tc_weight_" #name, offsetof(struct dp_tunables, tc_weight[tc]), 0, 64, "bursts" }
+
+static const struct dp_tunable_desc tunable_descs[] = {
+    DP_TUNABLE(rx_poll_interval, 0, US_PER_S, "us"),
+    DP_TUNABLE(rx_poll_adaptive, 0, 1, ""),
+    DP_TUNABLE(tx_drain_interval, 0, US_PER_S, "us"),
+    DP_TUNABLE(default_run_interval, 1, US_PER_S, "us"),
+    DP_TUNABLE(burst_rx, 1, DP_PORT_MAX_PKT_BURST_RX, "pkts"),
+    DP_TUNABLE(burst_tx, 1, DP_PORT_MAX_PKT_BURST_TX, "pkts"),
+    DP_TUNABLE(voq_limit, 1, 0, "pkts"),
+    DP_TUNABLE(back_pressure, 0, 1, ""),
+    DP_TUNABLE(ecn_threshold, 0, DP_RING_SIZE, "pkts"),
+    DP_TUNABLE(balance_interval, 0, 60 * MS_PER_S, "ms"),
+#ifndef DP_EGRESS_SCHED
+    DP_TUNABLE(adm_budget, 0, 1 << 20, "KB"),
+    DP_TUNABLE(adm_fragment_size, 1, 1 << 20, "bytes"),
+    DP_TUNABLE(adm_hold_max, 0, US_PER_S, "us"),
+    DP_TUNABLE(event_order, 0, 1, ""),
+    DP_TUNABLE_TC(ctrl, DP_TC_CTRL),
+    DP_TUNABLE_TC(req, DP_TC_REQ),
+    DP_TUNABLE_TC(data, DP_TC_DATA),
+    DP_TUNABLE_TC(bulk, DP_TC_BULK),
+#endif
+};
+
+#ifdef DP_EGRESS_SCHED
+/* the scheduler is fed from the voq lanes directly,
+ * admission control, event ordering and class weights are bypassed */
+static const char *sched_bypassed[] = {
+    "adm_budget", "adm_fragment_size", "adm_hold_max", "event_order",
+    "tc_weight_ctrl", "tc_weight_req", "tc_weight_data", "tc_weight_bulk",
+};
+#endif
+
+static uint32_t lane_size;
+
+void
+dp_tunables_init(uint32_t size)
+{
+    struct dp_tunables *t = &dp_tunables.t;
+
+    lane_size = size;
+
+    t->rx_poll_interval = DP_RX_POLL_INTERVAL;
+    t->rx_poll_adaptive = DP_RX_POLL_ADAPTIVE;
+    t->tx_drain_interval = DP_TX_DRAIN_INTERVAL;
+    t->default_run_interval = DP_DEFAULT_PIPELINE_RUN_INTERVAL;
+    t->burst_rx = DP_PORT_MAX_PKT_BURST_RX;
+    t->burst_tx = DP_PORT_MAX_PKT_BURST_TX;
+    /* lanes are sized in single mbuf packets,
+     * chained frames keep to the same number of mbufs */
+    t->voq_limit = RTE_MAX(size / daqswitch_get_max_frame_segs(), 1U);
+#ifdef DP_BACK_PRESSURE_DISABLE
+    t->back_pressure = 0;
+#else
+    t->back_pressure = 1;
+#endif
+    t->ecn_threshold = DP_ECN_THRESHOLD;
+    t->balance_interval = DP_BALANCE_INTERVAL;
+    t->adm_budget = DP_ADM_BUDGET;
+    t->adm_fragment_size = DP_ADM_FRAGMENT_SIZE;
+    t->adm_hold_max = DP_ADM_HOLD_MAX;
+#ifdef DP_EGRESS_SCHED
+    /* no tagging on rx for an order the tx lcore does not keep */
+    t->event_order = 0;
+#else
+    t->event_order = DP_EVENT_ORDER;
+#endif
+    t->tc_weight[DP_TC_CTRL] = 0;
+    t->tc_weight[DP_TC_REQ] = 0;
+    t->tc_weight[DP_TC_DATA] = DP_TC_WEIGHT_DATA;
+    t->tc_weight[DP_TC_BULK] = DP_TC_WEIGHT_BULK;
+
+    dp_tunables.epoch = 0;
+}
+
+int
+dp_param_set(const char *name, uint32_t value)
+{
+    const struct dp_tunable_desc *d = NULL;
+    uint32_t max;
+    unsigned i;
+
+    for (i = 0; i < RTE_DIM(tunable_descs); i++) {
+        if (strcmp(tunable_descs[i].name, name) == 0) {
+            d = &tunable_descs[i];
+        }
+    }
+
+    if (d == NULL) {
+#ifdef DP_EGRESS_SCHED
+        for (i = 0; i < RTE_DIM(sched_bypassed); i++) {
+            if (strcmp(sched_bypassed[i], name) == 0) {
+                printf("%s does not apply with DP_EGRESS_SCHED\n", name);
+                return DP_ERR;
+            }
+        }
+#endif
+        printf("unknown parameter %s\n", name);
+        return DP_ERR;
+    }
+
+    max = d->max ? d->max : lane_size;
+    if (value < d->min || value > max) {
+        printf("%s must be within [%u, %u]\n", name, d->min, max);
+        return DP_ERR;
+    }
+
+    /* odd epoch while updating, the lcores keep their copy meanwhile */
+    dp_tunables.epoch++;
+    rte_compiler_barrier();
+    *(uint32_t *) ((uint8_t *) &dp_tunables.t + d->offset) = value;
+    rte_compiler_barrier();
+    dp_tunables.epoch++;
+
+    return DP_SUCCESS;
+}
+
+void
+dp_dump_params(void)
+{
+    unsigned i;
+
+    printf("+----------------------+------------+--------+\n");
+    printf("| Parameter            | Value      | Unit   |\n");
+    printf("+----------------------+------------+--------+\n");
+    for (i = 0; i < RTE_DIM(tunable_descs); i++) {
+        printf("| %-20s | %10u | %6s |\n", tunable_descs[i].name,
+               *(const uint32_t *) ((const uint8_t *) &dp_tunables.t + tunable_descs[i].offset),
+               tunable_descs[i].unit);
+    }
+    printf("+----------------------+------------+--------+\n");
+    printf("epoch %u\n", dp_tunables.epoch);
+}
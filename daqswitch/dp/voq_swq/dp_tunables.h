@@ -0,0 +1,119 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef DP_TUNABLES_H
+#define DP_TUNABLES_H
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_branch_prediction.h>
+
+#include "dp_tc.h"
+#include "dp_admit.h"
+#include "dp_order.h"
+
+/* datapath parameters changeable at runtime with `set`
+ *
+ * the compile-time macros (DP_RX_POLL_INTERVAL etc.) give the defaults
+ * the command line is the only writer, it makes the epoch odd, updates
+ * the values and makes the epoch even again, every lcore keeps its own
+ * copy and refreshes it once per loop when it sees a new even epoch, so
+ * the hot loops only read a line that stays in their cache */
+struct dp_tunables {
+    uint32_t rx_poll_interval;     /* us */
+    uint32_t rx_poll_adaptive;
+    uint32_t tx_drain_interval;    /* us */
+    uint32_t default_run_interval; /* us */
+    uint32_t burst_rx;
+    uint32_t burst_tx;
+    /* max packets per voq lane, the lanes themselves keep their size */
+    uint32_t voq_limit;
+    uint32_t back_pressure;
+    /* voq depth above which packets are marked with ecn ce, 0 disables it */
+    uint32_t ecn_threshold;
+    /* period of the automatic lcore balancing, 0 disables it */
+    uint32_t balance_interval;     /* ms */
+    /* request admission control, see dp_admit.h, a budget of 0 disables it */
+    uint32_t adm_budget;           /* KB */
+    uint32_t adm_fragment_size;    /* bytes */
+    uint32_t adm_hold_max;         /* us */
+    /* serve the oldest event of a data voq first, see dp_order.h */
+    uint32_t event_order;
+    /* bursts per port round of each traffic class, 0 for strict priority */
+    uint32_t tc_weight[DP_TC_MAX];
+};
+
+struct dp_tunables_shared {
+    volatile uint32_t epoch;
+    struct dp_tunables t;
+} __rte_cache_aligned;
+
+/* copy held by an lcore, intervals converted to tsc */
+struct dp_tunables_local {
+    uint32_t epoch;
+    struct dp_tunables t;
+    uint64_t rx_poll_tsc;
+    uint64_t rx_poll_step_tsc;
+    uint64_t tx_drain_tsc;
+    uint64_t adm_hold_tsc;
+};
+
+extern struct dp_tunables_shared dp_tunables;
+
+static inline uint64_t
+dp_us_to_tsc(uint32_t us)
+{
+    return (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * us;
+}
+
+/* returns 1 if the local copy changed */
+static inline int
+dp_tunables_refresh(struct dp_tunables_local *l)
+{
+    uint32_t epoch = dp_tunables.epoch;
+
+    if (likely(epoch == l->epoch) || (epoch & 1)) {
+        return 0;
+    }
+
+    rte_compiler_barrier();
+    l->t = dp_tunables.t;
+    rte_compiler_barrier();
+
+    /* updated while copying, retry on the next call */
+    if (dp_tunables.epoch != epoch) {
+        return 0;
+    }
+
+    l->epoch = epoch;
+    l->rx_poll_tsc = dp_us_to_tsc(l->t.rx_poll_interval);
+    l->rx_poll_step_tsc = dp_us_to_tsc(DP_RX_POLL_STEP);
+    l->tx_drain_tsc = dp_us_to_tsc(l->t.tx_drain_interval);
+    l->adm_hold_tsc = dp_us_to_tsc(l->t.adm_hold_max);
+
+    return 1;
+}
+
+/* the shared epoch is even at rest, so the first refresh
+ * copies unless an update is in progress */
+static inline void
+dp_tunables_local_init(struct dp_tunables_local *l)
+{
+    l->epoch = 1;
+    while (!dp_tunables_refresh(l));
+}
+
+void dp_tunables_init(uint32_t lane_size);
+
+#endif /* DP_TUNABLES_H */
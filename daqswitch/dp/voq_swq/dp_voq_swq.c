@@ -9,6 +9,8 @@
  *
  * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
  */
+#include <string.h>
+
 #include <rte_lcore.h>
 #include <rte_byteorder.h>
 
@@ -16,194 +18,143 @@
 #include "../../daqswitch/daqswitch.h"
 #include "../../daqswitch/daqswitch_port.h"
 #include "../../pipeline/pipeline.h"
+#include "../../stats/stats.h"
 #include "../include/dp.h"
 
 #include "dp_voq_swq.h"
+#include "dp_event.h"
+#include "dp_tcpmon.h"
+#include "dp_tunables.h"
+#include "dp_plan.h"
+#include "dp_sched.h"
 
 struct dp_params dp;
 
 static void
 init_lcore_default(void)
 {
-    RTE_VERIFY(dp.nb_lcores >= 1);
+    uint16_t i;
+
+    RTE_VERIFY(dp.nb_lcores >= DP_LCORES_DEFAULT);
 
-    /* verify that the lcore is not used */
-    RTE_VERIFY(dp.lcores[DP_LCORE_ID_DEFAULT].type == DP_LCORE_TYPE_UNUSED);
+    for (i = 0; i < DP_LCORES_DEFAULT; i++) {
+        /* verify that the lcore is not used */
+        RTE_VERIFY(dp.lcores[DP_LCORE_ID_DEFAULT + i].type == DP_LCORE_TYPE_UNUSED);
 
-    dp.lcores[DP_LCORE_ID_DEFAULT].type = DP_LCORE_TYPE_DEFAULT;
+        dp.lcores[DP_LCORE_ID_DEFAULT + i].type = DP_LCORE_TYPE_DEFAULT;
+        dp.lcores[DP_LCORE_ID_DEFAULT + i].dflt.queue_idx = i;
+    }
 
 }
 
 #ifndef DAQ_DATA_FLOWS_DISABLE
-/* datapath rings store mbuf pointers of packets buffered in daqswitch
- * single ring corresponds to a single tx-queue
- * the rings should be multi-producer single-consumer
- * since the two lcores may be writting to the same ring */
-static void
-init_rings(void)
+/* datapath voqs store mbuf pointers of packets buffered in daqswitch
+ * single voq corresponds to a single data flow of the output port
+ * each voq has a spsc lane per input port, since a single input port
+ * is served by a single data rx lcore, the lane is on its socket
+ * returns the lane size */
+static uint32_t
+init_voqs(void)
 {
-    int i, j;
+    int i, j, k;
+    uint32_t lane_size;
 	char s[64];
 
     DP_LOG_ENTRY();
+
+#ifdef DP_LANE_SIZE
+    lane_size = rte_align32pow2(DP_LANE_SIZE);
+#else
+    lane_size = rte_align32pow2(DP_RING_SIZE) / rte_align32pow2(daqswitch_get_nb_ports());
+#endif
+    DP_LOG_DEBUG("\tlane size %u", lane_size);
+
     DAQSWITCH_PORT_FOREACH(i) {
 
         DP_LOG_DEBUG("\tport %d", i);
 
-        /* 1 tx-queue is the default queue without assiocated ring */
+        /* 1 tx-queue is the default queue without assiocated voq */
         for (j = 0; j < DP_PORT_MAX_DATA_FLOWS - 1; j++) {
-            DP_LOG_DEBUG("\t\t ring %d", j);
-            snprintf(s, sizeof(s), "dp_ring_p%d_q%d", i, j);
-            dp.rings[i][j] = rte_ring_create(s,
-                                             rte_align32pow2(DP_RING_SIZE),
-                                             DAQSWITCH_PORT_GET_NUMA(i),
-                                             RING_F_SC_DEQ);
-            RTE_VERIFY(dp.rings[i][j]);
+            DP_LOG_DEBUG("\t\t voq %d", j);
+            DAQSWITCH_PORT_FOREACH(k) {
+                snprintf(s, sizeof(s), "dp_lane_p%d_q%d_i%d", i, j, k);
+                dp.voqs[i][j].lanes[k] = dp_lane_create(s,
+                                                        lane_size,
+                                                        dp_plan_lane_socket(k));
+                RTE_VERIFY(dp.voqs[i][j].lanes[k]);
+            }
+            dp.voqs[i][j].nb_lanes = daqswitch_get_nb_ports();
+#ifndef DP_LATENCY_STATS_DISABLE
+            snprintf(s, sizeof(s), "dp_sojourn_p%d_q%d", i, j);
+            dp.voqs[i][j].sojourn = rte_zmalloc_socket(s, sizeof(struct stats_hist),
+                                                       CACHE_LINE_SIZE,
+                                                       DAQSWITCH_PORT_GET_NUMA(i));
+            RTE_VERIFY(dp.voqs[i][j].sojourn);
+#endif
         }
 
     }
     DP_LOG_EXIT();
+
+    return lane_size;
 }
 
-/* get next lcore of a given type with starting with lcore_id,
- * possibly on the specified socket_id */
-static struct dp_lcore_params *
-get_next_lcore(uint32_t lcore_id,
-               enum dp_lcore_type type,
-               unsigned socket_id)
+#ifndef DP_LATENCY_STATS_DISABLE
+/* sojourn time histograms of the tx queues,
+ * allocated on the socket of the port */
+static void
+init_latency_stats(void)
 {
-    uint32_t i, internal_id;
-    struct dp_lcore_params *lcore;
+    int i, j;
+    char s[64];
 
     DP_LOG_ENTRY();
 
-    /* find the internal id of the lcore in the list */
-    for (i = 0; i < dp.nb_lcores; i++) {
-        if (dp.lcores[i].id == lcore_id) {
-            internal_id = i;
-            break;
-        }
-    }
-    RTE_VERIFY(i < dp.nb_lcores);
-
-    DP_LOG_DEBUG("looking for next lcore: internal id %d lcore_id %d type %d numa %d",
-                  internal_id, lcore_id, type, socket_id);
-
-    bool numa_ok = true;
-start_over:
-    for (i = 0; i < dp.nb_lcores; i++) {
-        /* start with the next lcore in the list
-         * relative to the supplied lcore id*/
-        uint32_t id = (internal_id + i + 1) % dp.nb_lcores;
-
-        DP_LOG_DEBUG("\tcandidate: internal id %d lcore_id %d type %d nb_ports %d numa %d",
-                        id,
-                        dp.lcores[id].id,
-                        dp.lcores[id].type,
-                        dp.lcores[id].nb_ports,
-                        rte_lcore_to_socket_id(dp.lcores[id].id));
-
-        if ((dp.lcores[id].type == type)
-            && (dp.lcores[id].nb_ports < DP_LCORE_PORT_MAX)) {
-            DP_LOG_DEBUG("\ttype ok and enough queues available, checking numa..");
-            if (!(numa_ok)
-                || (socket_id == rte_lcore_to_socket_id(dp.lcores[id].id)) ) {
-
-                DP_LOG_DEBUG("hit");
-
-                lcore = &dp.lcores[id];
-
-                DP_LOG_EXIT();
-                return lcore;
-            }
+    DAQSWITCH_PORT_FOREACH(i) {
+        for (j = 0; j < DP_PORT_TXQ_MAX; j++) {
+            snprintf(s, sizeof(s), "dp_sojourn_p%d_txq%d", i, j);
+            dp.port_sojourn[i][j] = rte_zmalloc_socket(s, sizeof(struct stats_hist),
+                                                       CACHE_LINE_SIZE,
+                                                       DAQSWITCH_PORT_GET_NUMA(i));
+            RTE_VERIFY(dp.port_sojourn[i][j]);
         }
     }
 
-    /* if lcore not found yet, try again with non-optimal numa node */
-    if (numa_ok) {
-        numa_ok = false;
-        DP_LOG_DEBUG("not found yet, trying with numa check off");
-        goto start_over;
-    }
-
     DP_LOG_EXIT();
-    
-    return NULL;
 }
+#endif
 
-/* init data rx lcores
- * single lcore polls all rx queues
- * of at least a single port associated with the same numa node */
-static void
-init_lcores_data_rx(void)
+/* rx queues of an input port, a queue per output port */
+void
+dp_rx_port_conf_init(struct lcore_data_rx_port_conf *conf, uint8_t port_id)
 {
-    struct dp_lcore_params *lp;
-    uint32_t prev_lcore_id;
     uint16_t queue_id;
-    uint8_t port_id, nb_ports;
-
-    nb_ports = daqswitch_get_nb_ports();
-    prev_lcore_id = dp.lcores[DP_LCORE_ID_DEFAULT].id;
-
-    RTE_VERIFY(nb_ports <= DP_PORT_RXQ_MAX);
-
-    /* distribute ports across all available data rx lcores */
-    DAQSWITCH_PORT_FOREACH(port_id) {
-        lp = get_next_lcore(prev_lcore_id,
-                            DP_LCORE_TYPE_DATA_RX,
-                            DAQSWITCH_PORT_GET_NUMA(port_id));
-        RTE_VERIFY(lp);
-
-        /* initialize rx-queues 
-         * single rx-queue corresponds to single output port */
-        lp->rx.port_list[lp->nb_ports].port_id = port_id;
-        lp->rx.port_list[lp->nb_ports].nb_queues = nb_ports;
-        for (queue_id = 0; queue_id < nb_ports; queue_id++) {
-            lp->rx.port_list[lp->nb_ports].queue_list[queue_id].queue_id
-                        = DP_PORT_RXQ_ID_DATA_MIN + queue_id; 
-            lp->rx.port_list[lp->nb_ports].queue_list[queue_id].out_port_id
-                        = queue_id;
-        }
-        lp->nb_ports++;
-
-        prev_lcore_id = lp->id;
+    uint8_t nb_ports = daqswitch_get_nb_ports();
+
+    memset(conf, 0, sizeof(*conf));
+    conf->port_id = port_id;
+    conf->nb_queues = nb_ports;
+    for (queue_id = 0; queue_id < nb_ports; queue_id++) {
+        conf->queue_list[queue_id].queue_id = DP_PORT_RXQ_ID_DATA_MIN + queue_id; 
+        conf->queue_list[queue_id].out_port_id = queue_id;
     }
 }
 
-/* init data tx lcores
- * single lcore serves all tx queues
- * of at least a single port associated with the same numa node */
-static void
-init_lcores_data_tx(void)
+/* a tx port served by a single lcore */
+void
+dp_tx_port_conf_init(struct lcore_data_tx_port_conf *conf, uint8_t port_id)
 {
-    struct dp_lcore_params *lp;
-    uint32_t prev_lcore_id;
-    uint8_t port_id;
-
-    prev_lcore_id = dp.lcores[DP_LCORE_ID_DEFAULT].id;
-
-    /* distribute ports across all available data tx lcores */
-    DAQSWITCH_PORT_FOREACH(port_id) {
-        lp = get_next_lcore(prev_lcore_id,
-                            DP_LCORE_TYPE_DATA_TX,
-                            DAQSWITCH_PORT_GET_NUMA(port_id));
-        RTE_VERIFY(lp);
-
-        /* initialize tx-queues
-         * single tx-queue corresponds to single sink
-         * of a given data flow */
-        lp->tx.port_list[lp->nb_ports].port_id = port_id;
-        lp->nb_ports++;
-
-        prev_lcore_id = lp->id;
-    }
+    memset(conf, 0, sizeof(*conf));
+    conf->port_id = port_id;
+    conf->voq_mask = UINT64_MAX;
+    conf->queue_base = DP_PORT_TXQ_ID_TC(0);
 }
 #endif
 
 /* initialize lcore params
  * master lcore is not used for datapath processing, 
  * so it is not initialized here */
-static void
+static int
 init_lcores(void)
 {
     uint32_t lcore_id;
@@ -229,27 +180,10 @@ init_lcores(void)
     }
     RTE_VERIFY(lcores_free >= 2);
 
-    /* set available lcores as data rx or tx */
-    i = 0;
-    while (i < dp.nb_lcores) {
-        if (dp.lcores[i].type != DP_LCORE_TYPE_UNUSED) {
-            i++;
-            continue;
-        }
-
-        /* one rx, one tx
-         * this should ensure that rx and tx
-         * lcores are available on all numa nodes */
-        dp.lcores[i++].type = DP_LCORE_TYPE_DATA_RX;
-        if (i < dp.nb_lcores) {
-            dp.lcores[i++].type = DP_LCORE_TYPE_DATA_TX;
-        }
-
-    }
-
-    /* init them */
-    init_lcores_data_rx();
-    init_lcores_data_tx();
+    /* roles and ports of the data lcores */
+    return dp_plan_apply();
+#else
+    return DP_SUCCESS;
 #endif
 }
 
@@ -329,19 +263,44 @@ dp_init(void)
 {
     int ret;
     uint8_t portid;
+    uint32_t lane_size = 0;
 
     DP_LOG_ENTRY();
+
+    /* initialize lcore params, the voqs are placed after them */
+    DP_LOG_INFO("initializing lcores...");
+    ret = init_lcores();
+    DP_LOG_AND_RETURN_ON_ERR("failed to place the data lcores");
         
-    /* create rings */
-    DP_LOG_INFO("initializing datapath rings...");
+    /* create voqs */
+    DP_LOG_INFO("initializing datapath voqs...");
     //todo analyze the influence of number and size of rings on the performance
 #ifndef DAQ_DATA_FLOWS_DISABLE
-    init_rings();
+    lane_size = init_voqs();
 #endif
 
-    /* initialize lcore params */
-    DP_LOG_INFO("initializing lcores...");
-    init_lcores();
+    dp_tunables_init(lane_size);
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    dp_order_init();
+#ifdef DP_EGRESS_SCHED
+    DP_LOG_INFO("initializing egress schedulers...");
+    ret = dp_sched_init();
+    DP_LOG_AND_RETURN_ON_ERR("failed to create the egress schedulers");
+#endif
+#endif
+
+#ifndef DP_LATENCY_STATS_DISABLE
+    init_latency_stats();
+#endif
+
+#ifdef DP_EVENT_LATENCY
+    dp_event_init();
+#endif
+
+#ifdef DP_TCP_MONITOR
+    dp_tcpmon_init();
+#endif
 
     /* set the datapath thread */
     daqswitch_set_dp_thread(dp_main_loop);
@@ -369,23 +328,30 @@ dp_init(void)
         DP_LOG_AND_RETURN_ON_ERR("failed to set nb_txd on port %d", portid);
 
 #ifndef DAQ_DATA_FLOWS_DISABLE
-        /* single rx-queue per output ports + default queue */
-        ret = daqswitch_port_set_nb_rxq(portid, daqswitch_get_nb_ports() + 1);
+        /* single rx-queue per output ports + default queues */
+        ret = daqswitch_port_set_nb_rxq(portid, daqswitch_get_nb_ports() + DP_LCORES_DEFAULT);
 #else
-        /* default queue only */
-        ret = daqswitch_port_set_nb_rxq(portid, 1);
+        /* default queues only */
+        ret = daqswitch_port_set_nb_rxq(portid, DP_LCORES_DEFAULT);
 #endif
         DP_LOG_AND_RETURN_ON_ERR("failed to set nb_rxq on port %d", portid);
 
 #ifndef DAQ_DATA_FLOWS_DISABLE
-        /* tx-queue per data flow + default queue */
+        /* tx-queue per data flow + default queues */
         ret = daqswitch_port_set_nb_txq(portid, DP_PORT_TXQ_MAX);
 #else
-        /* default queue only */
-        ret = daqswitch_port_set_nb_txq(portid, 1);
+        /* default queues only */
+        ret = daqswitch_port_set_nb_txq(portid, DP_LCORES_DEFAULT);
 #endif
         DP_LOG_AND_RETURN_ON_ERR("failed to set nb_txq on port %d", portid);
 
+        /* spread the default queue over default lcores
+         * tcp hashing keeps a single connection on a single lcore */
+        if (DP_LCORES_DEFAULT > 1) {
+            ret = daqswitch_port_set_rss(portid, ETH_RSS_IP | ETH_RSS_TCP, DP_LCORES_DEFAULT);
+            DP_LOG_AND_RETURN_ON_ERR("failed to set rss on port %d", portid);
+        }
+
 #ifndef DAQ_DATA_FLOWS_DISABLE
         ret = daqswitch_port_set_fdir_forwarding(portid, &fdir_mask);
         DP_LOG_AND_RETURN_ON_ERR("failed to set flow director on port %d", portid);
@@ -445,6 +411,13 @@ dp_configure(void)
         }
     }
 
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    if (dp_balance_init() != DP_SUCCESS) {
+        DP_LOG_ERR("cannot start the lcore balancer");
+        return DP_ERR;
+    }
+#endif
+
     DP_LOG_EXIT();
 
     return DP_SUCCESS;
@@ -469,6 +442,7 @@ dp_dump_cfg(void)
 
         case DP_LCORE_TYPE_DEFAULT:
             printf("type: default\n");
+            printf("\trx/tx queue %3d\n", lp->dflt.queue_idx);
             break;
             
 #ifndef DAQ_DATA_FLOWS_DISABLE
@@ -484,10 +458,19 @@ dp_dump_cfg(void)
         case DP_LCORE_TYPE_DATA_TX:
             printf("type: data tx\n");
             for (j = 0; j < lp->nb_ports; j++) {
-                printf("\tport_id %3d active_flows 0x%0" PRIX64 "\n",
+                printf("\tport_id %3d active_flows 0x%0" PRIX64 " voq_mask 0x%0" PRIX64
+                       " txqs %d-%d\n",
                         lp->tx.port_list[j].port_id,
-                        lp->tx.port_list[j].active_flows
+                        dp.active_flows[lp->tx.port_list[j].port_id],
+                        lp->tx.port_list[j].voq_mask,
+                        lp->tx.port_list[j].queue_base,
+                        lp->tx.port_list[j].queue_base + DP_TC_MAX - 1
                         );
+#ifdef DP_EGRESS_SCHED
+                printf("\t\tscheduler queued %u dropped %" PRIu64 "\n",
+                       dp_sched_get(lp->tx.port_list[j].port_id, lp->tx.port_list[j].queue_base)->nb_queued,
+                       dp_sched_get(lp->tx.port_list[j].port_id, lp->tx.port_list[j].queue_base)->dropped);
+#endif
             }
             break;
 #endif
@@ -501,24 +484,153 @@ dp_dump_cfg(void)
     uint8_t port_id;
     unsigned count;
 
-    printf("+------+-------+----------------+------------+-----------------+-----------------+\n");
-    printf("| Port | Queue | Destination IP |  Sink Id   | Is request flow | Ring occupancy  |\n");
-    printf("+------+-------+----------------+------------+-----------------+-----------------+\n");
+    printf("+------+-------+----------------+------------+-----------------+-------+-----------------+\n");
+    printf("| Port | Queue | Destination IP |  Sink Id   | Is request flow | Class | Ring occupancy  |\n");
+    printf("+------+-------+----------------+------------+-----------------+-------+-----------------+\n");
 
     DAQSWITCH_PORT_FOREACH(port_id) {
         for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
 
             if (dp.flows[port_id][i].active) {
-                count = rte_ring_count(dp.rings[port_id][i]); 
-                printf("| %4d | %5d |     0x%08x | 0x%08x |               %1d | %15d |\n",
-                       port_id, i, dp.flows[port_id][i].dest_ip, dp.flows[port_id][i].sink_id, dp.flows[port_id][i].req_flow, count);
+                count = dp_voq_count(&dp.voqs[port_id][i]);
+                printf("| %4d | %5d |     0x%08x | 0x%08x |               %1d | %5s | %15d |\n",
+                       port_id, i, dp.flows[port_id][i].dest_ip, dp.flows[port_id][i].sink_id, dp.flows[port_id][i].req_flow,
+                       dp_tc_names[dp.flows[port_id][i].tc], count);
             }
         }
     }
 
-    printf("+------+-------+----------------+------------+-----------------+-----------------+\n");
+    printf("+------+-------+----------------+------------+-----------------+-------+-----------------+\n");
 
 #endif
 
     DP_LOG_EXIT();
 }
+
+/* sojourn time percentiles per port, then per active voq */
+void
+dp_dump_latency(void)
+{
+#ifndef DP_LATENCY_STATS_DISABLE
+    struct stats_hist h;
+    uint8_t port_id;
+    uint32_t i;
+    char s[32];
+
+    stats_hist_print_header();
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        stats_hist_reset(&h);
+        for (i = 0; i < DP_PORT_TXQ_MAX; i++) {
+            stats_hist_merge(&h, dp.port_sojourn[port_id][i]);
+        }
+        snprintf(s, sizeof(s), "port %d", port_id);
+        stats_hist_print(s, &h);
+    }
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+    stats_hist_print_footer();
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
+            if (!dp.flows[port_id][i].active || dp.voqs[port_id][i].sojourn == NULL) {
+                continue;
+            }
+
+            /* work on a copy, the histogram keeps being updated */
+            stats_hist_reset(&h);
+            stats_hist_merge(&h, dp.voqs[port_id][i].sojourn);
+            snprintf(s, sizeof(s), "port %d voq %d%s", port_id, i,
+                     dp.flows[port_id][i].req_flow ? " req" : "");
+            stats_hist_print(s, &h);
+        }
+    }
+#endif
+
+    stats_hist_print_footer();
+
+#ifdef DP_EVENT_LATENCY
+    dp_event_dump();
+#endif
+#else
+    printf("latency stats disabled at build time\n");
+#endif
+}
+
+void
+dp_reset_latency(void)
+{
+#ifndef DP_LATENCY_STATS_DISABLE
+    uint8_t port_id;
+    uint32_t i;
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        for (i = 0; i < DP_PORT_TXQ_MAX; i++) {
+            stats_hist_reset(dp.port_sojourn[port_id][i]);
+        }
+#ifndef DAQ_DATA_FLOWS_DISABLE
+        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS; i++) {
+            if (dp.voqs[port_id][i].sojourn) {
+                stats_hist_reset(dp.voqs[port_id][i].sojourn);
+            }
+        }
+#endif
+    }
+
+#ifdef DP_EVENT_LATENCY
+    dp_event_reset();
+#endif
+#endif
+}
+
+/* a record per active data flow and one for the default path of each port,
+ * the counters are read without synchronization */
+unsigned
+dp_flow_records_get(struct dp_flow_record *records, unsigned max)
+{
+    struct dp_flow_record *r;
+    unsigned nb_records = 0;
+    uint8_t port_id;
+    uint32_t i;
+
+    DAQSWITCH_PORT_FOREACH(port_id) {
+        if (nb_records == max) {
+            break;
+        }
+
+        /* the default path counts packets only */
+        r = &records[nb_records++];
+        memset(r, 0, sizeof(*r));
+        r->port_id = port_id;
+        r->flow_id = DP_FLOW_RECORD_DEFAULT;
+        for (i = 0; i < DP_LCORES_DEFAULT; i++) {
+            r->packets += daqswitch_tx_queue_stats[port_id][DP_PORT_TXQ_ID_DEFAULT + i].total_packets;
+        }
+
+#ifndef DAQ_DATA_FLOWS_DISABLE
+        for (i = 0; i < DP_PORT_MAX_DATA_FLOWS && nb_records < max; i++) {
+            struct data_flow *flow = &dp.flows[port_id][i];
+
+            if (!flow->active) {
+                continue;
+            }
+
+            r = &records[nb_records++];
+            r->port_id = port_id;
+            r->flow_id = i;
+            r->req_flow = flow->req_flow;
+            r->dest_ip = flow->dest_ip;
+            r->sink_id = flow->sink_id;
+            r->packets = flow->packets;
+            r->bytes = flow->bytes;
+            r->start_tsc = flow->start_tsc;
+            r->end_tsc = flow->end_tsc;
+            r->max_depth = flow->max_depth;
+            r->stall_cycles = rte_atomic64_read(&flow->stall_cycles);
+            r->ecn_marked = rte_atomic64_read(&flow->ecn_marked);
+        }
+#endif
+    }
+
+    return nb_records;
+}
@@ -13,44 +13,98 @@
 #define DP_VOQ_SWQ_H
 
 #include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
 
 #include <rte_ring.h>
 #include <rte_mbuf.h>
+#include <rte_port.h>
+#include <rte_atomic.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
 
 #include "../../daqswitch/daqswitch.h"
+#include "../../stats/stats_hist.h"
 
-/* timing */
+#include "dp_lane.h"
+#include "dp_tc.h"
+
+/* timing, defaults of the runtime tunables, see dp_tunables.h */
 #ifndef DP_RX_POLL_INTERVAL
     #define DP_RX_POLL_INTERVAL                                                        100 /* us */
 #endif
+/* the poll interval of each rx queue adapts to the traffic,
+ * DP_RX_POLL_INTERVAL is then the upper bound */
+#ifndef DP_RX_POLL_ADAPTIVE
+    #define DP_RX_POLL_ADAPTIVE                                                          1
+#endif
+#define DP_RX_POLL_STEP                                                                  1 /* us */
 #ifndef DP_TX_DRAIN_INTERVAL
     #define DP_TX_DRAIN_INTERVAL                                                       10  /* us */
 #endif
-#define DP_DEFAULT_PIPELINE_RUN_INTERVAL                                               200 /* us */
+/* upper bound of the idle back-off of the default pipelines */
+#ifndef DP_DEFAULT_PIPELINE_RUN_INTERVAL
+    #define DP_DEFAULT_PIPELINE_RUN_INTERVAL                                           200 /* us */
+#endif
+
+/* voq depth above which ecn capable packets get the ce codepoint
+ * on enqueue, 0 disables the marking */
+#ifndef DP_ECN_THRESHOLD
+    #define DP_ECN_THRESHOLD                                                             0 /* pkts */
+#endif
+
+/* automatic lcore balancing period, 0 disables it, see dp_balance.c */
+#ifndef DP_BALANCE_INTERVAL
+    #define DP_BALANCE_INTERVAL                                                          0 /* ms */
+#endif
 
 /* lcore defines */
 #define DP_LCORE_ID_DEFAULT                                                               0
 #define DP_LCORE_PORT_MAX                                                                16
+/* number of lcores running the default pipeline,
+ * the default queue of each port is spread over them with rss */
+#ifndef DP_LCORES_DEFAULT
+    #define DP_LCORES_DEFAULT                                                             1
+#endif
 
-/* port defines */
+/* port defines
+ * rx queues: DP_LCORES_DEFAULT default queues, then a data queue per output port
+ * tx queues: a default queue per default lcore, then a queue per traffic class,
+ * then another one per class used by a second tx lcore when the port is split */
 #define DP_PORT_TXQ_ID_DEFAULT                                                            0
-#define DP_PORT_TXQ_ID_REQ                                                                1
-#define DP_PORT_TXQ_ID_DATA                                                               2
-#define DP_PORT_RXQ_MAX                                             DAQSWITCH_MAX_PORTS + 1
-#define DP_PORT_TXQ_MAX                                                                   3
+#define DP_PORT_TXQ_ID_TC(tc)                                        (DP_LCORES_DEFAULT + (tc))
+#define DP_PORT_RXQ_MAX                             (DAQSWITCH_MAX_PORTS + DP_LCORES_DEFAULT)
+#define DP_PORT_TXQ_ID_TC_SPLIT(tc)                      (DP_LCORES_DEFAULT + DP_TC_MAX + (tc))
+#define DP_PORT_TXQ_MAX                                   (DP_LCORES_DEFAULT + 2 * DP_TC_MAX)
 #define DP_PORT_RXQ_ID_DEFAULT                                                            0
-#define DP_PORT_RXQ_ID_DATA_MIN                                                           1
+#define DP_PORT_RXQ_ID_DATA_MIN                                           (DP_LCORES_DEFAULT)
 #define DP_PORT_MAX_PKT_BURST_RX                                                         32
 #define DP_PORT_MAX_PKT_BURST_TX                                                         32
+#define DP_PORT_RX_PREFETCH_OFFSET                                                        4
 #define DP_PORT_MAX_DATA_FLOWS                                                           64
 
-/* ring defines */
+/* ring defines
+ * DP_RING_SIZE is the capacity of a voq, split evenly over its lanes
+ * unless DP_LANE_SIZE is given */
 #ifndef DP_RING_SIZE
     #define DP_RING_SIZE                                           DAQSWITCH_MBUFS_PER_PORT
 #endif
 
 /* default queue */
 #define DP_FORWARDING_RULES_MAX                                                        1024
+#ifndef DP_KNOWN_FLOWS_MAX
+    #define DP_KNOWN_FLOWS_MAX                                                         4096
+#endif
+#define DP_KNOWN_FLOWS_BUCKET_ENTRIES                                                     4
+
+/* latency stats
+ * the rx tsc is stamped into the mbuf metadata right after the flow key,
+ * the sojourn time is recorded when the packet is handed to the nic */
+#ifndef DP_LATENCY_STATS_DISABLE
+#define DP_MBUF_META_RX_TSC_OFFSET                                                       32
+#define DP_MBUF_RX_TSC(m)                RTE_MBUF_METADATA_UINT64(m, DP_MBUF_META_RX_TSC_OFFSET)
+#endif
 
 /* mask for the fdir id identifying the output queue */
 #define DP_FDIR_OUT_QUEUE_MASK                                                          0x3f
@@ -75,30 +129,215 @@ struct data_flow {
 
     bool active;
     bool req_flow;
+    /* traffic class, see dp_tc.h */
+    uint8_t tc;
+    /* dcm credited with the packets sent, data flows only, see dp_admit.h */
+    uint16_t adm_slot;
 
     uint32_t dest_ip;
     uint32_t sink_id;
 
+    /* flow record counters, written by the tx lcore of the port */
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+    uint32_t max_depth;
+
+    /* time the rx lcores waited for room in the voq */
+    rte_atomic64_t stall_cycles __rte_cache_aligned;
+    /* packets marked with ecn ce by the rx lcores */
+    rte_atomic64_t ecn_marked;
+
 } __rte_cache_aligned;
 
 struct lcore_data_rx_port_conf {
     uint8_t port_id;
     uint16_t nb_queues;
+    /* cycles of rounds with packets received on the port */
+    uint64_t busy_tsc;
     struct data_rx_queue queue_list[DP_PORT_RXQ_MAX];
 } __rte_cache_aligned;
 
+/* virtual output queue
+ * a lane per input port, so every lane has a single producer
+ * (the lcore serving the input port) and a single consumer */
+struct dp_voq {
+    struct dp_lane *lanes[DAQSWITCH_MAX_PORTS];
+    uint8_t nb_lanes;
+
+    /* next lane to serve, consumer only */
+    uint8_t lane_next __rte_cache_aligned;
+#ifndef DP_LATENCY_STATS_DISABLE
+    /* sojourn time, consumer only */
+    struct stats_hist *sojourn;
+#endif
+    /* tsc since the head request of each lane is held, consumer only */
+    uint64_t adm_hold_tsc[DAQSWITCH_MAX_PORTS];
+} __rte_cache_aligned;
+
+/* number of packets buffered in a voq, approximate as it
+ * reads the indices of lanes owned by other lcores */
+static inline unsigned
+dp_voq_count(const struct dp_voq *voq)
+{
+    unsigned count = 0;
+    uint8_t k;
+
+    for (k = 0; k < voq->nb_lanes; k++) {
+        count += dp_lane_count(voq->lanes[k]);
+    }
+
+    return count;
+}
+
+/* multiplicative hash, the high bits are the best mixed */
+static inline uint32_t
+dp_hash64(uint64_t v)
+{
+    return (uint32_t) ((v * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+/* hash of the tcp connection of a packet */
+static inline uint32_t
+dp_conn_hash(const struct ipv4_hdr *ip_hdr, const struct tcp_hdr *tcp_hdr)
+{
+    return dp_hash64(((uint64_t) ip_hdr->src_addr << 32 | ip_hdr->dst_addr) ^
+                     ((uint64_t) tcp_hdr->src_port << 16 | tcp_hdr->dst_port));
+}
+
+/* tcp payload of a packet, NULL if it is not ipv4/tcp or its headers are
+ * not all in the first segment, *len is clamped to the bytes in the mbuf
+ * chain, so a payload longer than the first segment has to be read with
+ * dp_pkt_read */
+static inline uint8_t *
+dp_pkt_tcp_payload(struct rte_mbuf *pkt, struct ipv4_hdr **ip_hdr,
+                   struct tcp_hdr **tcp_hdr, uint32_t *len)
+{
+    struct ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct ether_hdr *);
+    uint32_t ip_len, tcp_len, hdr_len, total_len;
+
+    if (rte_pktmbuf_data_len(pkt) < sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) ||
+        eth_hdr->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4)) {
+        return NULL;
+    }
+
+    *ip_hdr = (struct ipv4_hdr *) (eth_hdr + 1);
+    ip_len = ((*ip_hdr)->version_ihl & 0xf) * 4;
+    if ((*ip_hdr)->next_proto_id != IPPROTO_TCP || ip_len < sizeof(struct ipv4_hdr) ||
+        rte_pktmbuf_data_len(pkt) < sizeof(struct ether_hdr) + ip_len + sizeof(struct tcp_hdr)) {
+        return NULL;
+    }
+
+    *tcp_hdr = (struct tcp_hdr *) ((uint8_t *) *ip_hdr + ip_len);
+    tcp_len = ((*tcp_hdr)->data_off >> 4) * 4;
+    hdr_len = sizeof(struct ether_hdr) + ip_len + tcp_len;
+    total_len = rte_be_to_cpu_16((*ip_hdr)->total_length);
+    if (tcp_len < sizeof(struct tcp_hdr) || rte_pktmbuf_data_len(pkt) < hdr_len ||
+        total_len < ip_len + tcp_len) {
+        return NULL;
+    }
+
+    *len = RTE_MIN(total_len - ip_len - tcp_len, rte_pktmbuf_pkt_len(pkt) - hdr_len);
+    return (uint8_t *) *tcp_hdr + tcp_len;
+}
+
+/* n bytes at offset off of a packet, in place if they are in one segment,
+ * otherwise copied to buf, NULL if the packet is shorter */
+static inline const void *
+dp_pkt_read(const struct rte_mbuf *pkt, uint32_t off, uint32_t n, void *buf)
+{
+    uint8_t *dst = buf;
+    uint32_t k;
+
+    while (pkt != NULL && off >= rte_pktmbuf_data_len(pkt)) {
+        off -= rte_pktmbuf_data_len(pkt);
+        pkt = pkt->next;
+    }
+    if (pkt == NULL) {
+        return NULL;
+    }
+
+    if (off + n <= rte_pktmbuf_data_len(pkt)) {
+        return rte_pktmbuf_mtod(pkt, const uint8_t *) + off;
+    }
+
+    for (; n > 0; pkt = pkt->next, off = 0) {
+        if (pkt == NULL) {
+            return NULL;
+        }
+        k = RTE_MIN(n, rte_pktmbuf_data_len(pkt) - off);
+        memcpy(dst, rte_pktmbuf_mtod(pkt, const uint8_t *) + off, k);
+        dst += k;
+        n -= k;
+    }
+
+    return buf;
+}
+
+/* a port, or a part of its data voqs when split over two lcores */
 struct lcore_data_tx_port_conf {
     uint8_t port_id;
-    uint64_t active_flows;
+    /* voqs served and the tx queue of their class 0,
+     * DP_PORT_TXQ_ID_TC(0) or DP_PORT_TXQ_ID_TC_SPLIT(0) */
+    uint64_t voq_mask;
+    uint16_t queue_base;
+    /* cycles of rounds with packets sent on the port */
+    uint64_t busy_tsc;
 } __rte_cache_aligned;
 #endif
 
+/* cycles of the main loop, written by the lcore */
+struct dp_lcore_load {
+    uint64_t busy_tsc;
+    uint64_t total_tsc;
+};
+
+/* requests to a data lcore, polled once per port round
+ * the balancer posts a command and waits for the lcore to clear it, the
+ * lcore claims it first, so a command not claimed in time is withdrawn */
+enum dp_mbox_cmd {
+    DP_MBOX_NONE = 0,
+    /* stop serving the port, pending tx packets are sent first */
+    DP_MBOX_RELEASE,
+    /* start serving the port, merging with a part already served */
+    DP_MBOX_ADOPT,
+    /* tx only, keep serving the voqs in voq_mask only */
+    DP_MBOX_SET_MASK,
+    /* claimed by the lcore */
+    DP_MBOX_BUSY,
+};
+
+/* time a tx lcore tries to send the packets pending on a port it hands
+ * over, the port stays with it if the nic does not take them meanwhile */
+#ifndef DP_MBOX_DRAIN_TIMEOUT
+    #define DP_MBOX_DRAIN_TIMEOUT                                                       10 /* ms */
+#endif
+
+struct dp_lcore_mbox {
+    volatile uint32_t cmd;
+    /* DP_SUCCESS or DP_ERR, set before the command is cleared */
+    volatile int ret;
+    uint8_t port_id;
+    uint64_t voq_mask;
+    uint16_t queue_base;
+} __rte_cache_aligned;
+
 struct dp_lcore_params {
     uint32_t id;
     enum dp_lcore_type type;
 
+    struct dp_lcore_load load;
+    struct dp_lcore_mbox mbox;
+
     uint8_t nb_ports;
     union {
+        /* default lcore */
+        struct {
+            /* index of the default rx/tx queue served */
+            uint16_t queue_idx;
+        } dflt;
+
 #ifndef DAQ_DATA_FLOWS_DISABLE
         /* data_rx lcore */
         struct { 
@@ -119,9 +358,18 @@ struct dp_params {
     struct dp_lcore_params lcores[DAQSWITCH_MAX_LCORES];
     uint32_t nb_lcores;
 
-    /* rings */
-    struct rte_ring *rings[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
+    /* voqs */
+    struct dp_voq voqs[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
     struct data_flow flows[DAQSWITCH_MAX_PORTS][DP_PORT_MAX_DATA_FLOWS];
+    /* voqs to serve per port, set by the default lcores */
+    volatile uint64_t active_flows[DAQSWITCH_MAX_PORTS];
+    /* the same split by traffic class, the tx lcores serve these */
+    volatile uint64_t tc_flows[DAQSWITCH_MAX_PORTS][DP_TC_MAX];
+
+#ifndef DP_LATENCY_STATS_DISABLE
+    /* sojourn time per tx queue, each written by the lcore serving the queue */
+    struct stats_hist *port_sojourn[DAQSWITCH_MAX_PORTS][DP_PORT_TXQ_MAX];
+#endif
 
 } __rte_cache_aligned;
 
@@ -130,6 +378,11 @@ void dp_configure_lcore_default(struct dp_lcore_params *lp);
 void dp_configure_lcore_data_tx(struct dp_lcore_params *lp);
 void dp_configure_lcore_data_rx(struct dp_lcore_params *lp);
 int add_ipv4_rule(uint32_t ipv4, uint8_t port_out_id);
+#ifndef DAQ_DATA_FLOWS_DISABLE
+void dp_rx_port_conf_init(struct lcore_data_rx_port_conf *conf, uint8_t port_id);
+void dp_tx_port_conf_init(struct lcore_data_tx_port_conf *conf, uint8_t port_id);
+int dp_balance_init(void);
+#endif
 
 /* main processing loops */
 void dp_main_loop_lcore_default(struct dp_lcore_params *lp);
@@ -22,6 +22,7 @@
 #include "daqswitch/daqswitch.h"
 #include "daqswitch/daqswitch_flow.h"
 #include "stats/stats.h"
+#include "stats/ipfix.h"
 
 int
 main(int argc, char **argv)
@@ -68,6 +69,12 @@ main(int argc, char **argv)
     }
     printf("Done\n");
 
+    /* periodic flow record export, if configured */
+    ret = ipfix_start();
+    if (ret < 0) {
+        rte_exit(EXIT_FAILURE, "Flow record export failed\n");
+    }
+
     /* launch stats and message handling */
     rte_delay_ms(3000);
 
@@ -20,11 +20,29 @@
 #include <rte_ether.h>
 #include <rte_ip.h>
 #include <rte_tcp.h>
+#include <rte_prefetch.h>
 
 #include "../common/common.h"
 #include "../daqswitch/daqswitch.h"
 
 #include "pipeline.h"
+#include "pipeline_metadata.h"
+
+/* packets prefetched ahead of the metadata fill */
+#define PKT_PREFETCH_OFFSET                                                8
+
+/* 4 packets at once, debug output is available in the scalar version only */
+#if defined(PIPELINE_METADATA_FILL_X4) && !defined(PIPELINE_DBG)
+#define PKT_METADATA_FILL_X4
+#endif
+/* slab0 and the tdaq slabs of the flow key */
+#ifdef PIPELINE_DATA_DISABLE
+#define PKT_METADATA_SIP                                                   0
+#define PKT_METADATA_TDAQ                                                  0
+#else
+#define PKT_METADATA_SIP                                                   1
+#define PKT_METADATA_TDAQ                                                  1
+#endif
 
 #ifdef PIPELINE_DBG
 static void dump_pkt(struct rte_mbuf *pkt)
@@ -157,6 +175,19 @@ pkt_metadata_fill(struct rte_mbuf *m)
 #endif
 }
 
+/* headers, tdaq header (second cache line) and metadata */
+static inline void
+pkt_prefetch(struct rte_mbuf *m)
+{
+    uint8_t *m_data = rte_pktmbuf_mtod(m, uint8_t *);
+
+    rte_prefetch0(m_data);
+#ifndef PIPELINE_DATA_DISABLE
+    rte_prefetch0(m_data + CACHE_LINE_SIZE);
+#endif
+    rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(m, 0));
+}
+
 /* default action for all rx packets */
 static int
 rx_action_handler(struct rte_mbuf               **pkts,
@@ -164,37 +195,34 @@ rx_action_handler(struct rte_mbuf               **pkts,
                   uint64_t                  *pkts_mask,
                   __rte_unused void               *arg)
 {
-    int i;
+    uint32_t i;
 
-#if 0
-#define PREFETCH_OFFSET 3
-    /* prefetch first packets */
-    for (i = 0; i < PREFETCH_OFFSET && i < (int) n; i++) {
-        rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *)); 
-        //rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(pkts[i], 0));
+    for (i = 0; i < PKT_PREFETCH_OFFSET && i < n; i++) {
+        pkt_prefetch(pkts[i]);
     }
 
-    /* prefetch and process already prefetched packets */
-    for (i = 0; i < ((int) n - PREFETCH_OFFSET); i++) {
-        rte_prefetch0(rte_pktmbuf_mtod(pkts[i + PREFETCH_OFFSET], void *)); 
-        //rte_prefetch0(RTE_MBUF_METADATA_UINT8_PTR(pkts[i + PREFETCH_OFFSET], 0));
-        pkt_metadata_fill(pkts[i]);
-    }
+    i = 0;
+#ifdef PKT_METADATA_FILL_X4
+    for ( ; i + 4 <= n; i += 4) {
+        uint32_t j;
 
-    /* process remaining prefetched packets */
-    for (; i < (int) n; i++) {
-        pkt_metadata_fill(pkts[i]);
+        for (j = i + PKT_PREFETCH_OFFSET; j < i + PKT_PREFETCH_OFFSET + 4 && j < n; j++) {
+            pkt_prefetch(pkts[j]);
+        }
+
+        pipeline_metadata_fill_x4(&pkts[i], PKT_METADATA_SIP, PKT_METADATA_TDAQ);
     }
 #endif
+    for ( ; i < n; i++) {
+        if (i + PKT_PREFETCH_OFFSET < n) {
+            pkt_prefetch(pkts[i + PKT_PREFETCH_OFFSET]);
+        }
 
-#if 1
-    for (i = 0; i < (int) n; i++) {
         pkt_metadata_fill(pkts[i]);
 #ifdef PIPELINE_DBG
         dump_pkt(pkts[i]);
 #endif
     }
-#endif
 
 #if 0
     i = 0;
@@ -0,0 +1,97 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef PIPELINE_METADATA_H
+#define PIPELINE_METADATA_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_byteorder.h>
+
+/* metadata fill of 4 packets at once, shared by the default pipeline
+ * and the default lcore of voq_swq, both lay out the flow key at
+ * metadata offset 0 as
+ *   slab0  ttl, proto, header checksum and sip (if sip)
+ *   slab1  dip, sport and dport
+ *   slab2  tdaq type and transaction id (if tdaq)
+ *   slab3  tdaq size and event id (if tdaq) */
+#ifdef RTE_MACHINE_CPUFLAG_SSE2
+#define PIPELINE_METADATA_FILL_X4
+#include <rte_vect.h>
+
+/* tdaq header bytes in slab2 and slab3 */
+#define PIPELINE_METADATA_TDAQ_SIZE                                16
+
+#define PIPELINE_METADATA_FILL_X4_TDAQ(k)                                           \
+    _mm_storeu_si128((__m128i *) RTE_MBUF_METADATA_UINT8_PTR(m[k], 16),             \
+                     _mm_and_si128(_mm_shuffle_epi32(valid, _MM_SHUFFLE(k, k, k, k)), \
+                                   _mm_loadu_si128((__m128i *)                      \
+                                        ((uint8_t *) (ip_hdr[k] + 1) + tcp_hdr_size[k]))))
+
+/* flow key of 4 packets, the scalar fill of the callers for 4 packets
+ * l3/l4 fields are copied with a single 16 byte load/store,
+ * tdaq slabs are masked out for packets without a tdaq header
+ * (the load stays within the mbuf data room: tcp header is max 60 bytes)
+ * sip and tdaq are constants of the caller, so the unused parts compile out */
+static inline void
+pipeline_metadata_fill_x4(struct rte_mbuf **m, int sip, int tdaq)
+{
+    struct ipv4_hdr *ip_hdr[4];
+    uint32_t k;
+
+    for (k = 0; k < 4; k++) {
+        ip_hdr[k] = (struct ipv4_hdr *)
+            (rte_pktmbuf_mtod(m[k], uint8_t *) + sizeof(struct ether_hdr));
+
+        if (sip) {
+            /* start with ttl, end with tcp src and dest ports */
+            _mm_storeu_si128((__m128i *) RTE_MBUF_METADATA_UINT8_PTR(m[k], 0),
+                             _mm_loadu_si128((__m128i *) ((uint8_t *) ip_hdr[k] + 8)));
+        } else {
+            _mm_storel_epi64((__m128i *) RTE_MBUF_METADATA_UINT8_PTR(m[k], 0),
+                             _mm_loadl_epi64((__m128i *) ((uint8_t *) ip_hdr[k] + 16)));
+        }
+    }
+
+    if (tdaq) {
+        uint8_t tcp_hdr_size[4];
+
+        for (k = 0; k < 4; k++) {
+            tcp_hdr_size[k] = (((struct tcp_hdr *) (ip_hdr[k] + 1))->data_off >> 4) * 4;
+        }
+
+        /* tdaq header present if tcp with enough payload */
+        const __m128i proto_tcp = _mm_set1_epi32(IPPROTO_TCP);
+        const __m128i len_min = _mm_set1_epi32(sizeof(struct ipv4_hdr) + PIPELINE_METADATA_TDAQ_SIZE - 1);
+
+        __m128i proto = _mm_set_epi32(ip_hdr[3]->next_proto_id, ip_hdr[2]->next_proto_id,
+                                      ip_hdr[1]->next_proto_id, ip_hdr[0]->next_proto_id);
+        __m128i len = _mm_set_epi32(rte_be_to_cpu_16(ip_hdr[3]->total_length) - tcp_hdr_size[3],
+                                    rte_be_to_cpu_16(ip_hdr[2]->total_length) - tcp_hdr_size[2],
+                                    rte_be_to_cpu_16(ip_hdr[1]->total_length) - tcp_hdr_size[1],
+                                    rte_be_to_cpu_16(ip_hdr[0]->total_length) - tcp_hdr_size[0]);
+        __m128i valid = _mm_and_si128(_mm_cmpeq_epi32(proto, proto_tcp),
+                                      _mm_cmpgt_epi32(len, len_min));
+
+        PIPELINE_METADATA_FILL_X4_TDAQ(0);
+        PIPELINE_METADATA_FILL_X4_TDAQ(1);
+        PIPELINE_METADATA_FILL_X4_TDAQ(2);
+        PIPELINE_METADATA_FILL_X4_TDAQ(3);
+    }
+}
+#endif
+
+#endif /* PIPELINE_METADATA_H */
@@ -0,0 +1,80 @@
+#!/usr/bin/env python
+# decodes a daqswitch trace dump (trace dump / crash) into text,
+# events of all lcores merged in time order
+#
+# usage: trace_decode.py daqswitch.trace [--last N]
+import struct
+import sys
+
+# keep in sync with enum trace_event_type in trace/trace.h
+EVENTS = [
+    'none',
+    'flow_detected',
+    'filter_added',
+    'voq_activated',
+    'voq_full',
+    'txq_full',
+    'stall_begin',
+    'stall_end',
+    'pause_rx',
+    'adm_hold',
+]
+
+FILE_HDR = struct.Struct('<8sIIIIQ')
+RING_HDR = struct.Struct('<IIQ')
+EVENT = struct.Struct('<QHBBI')
+LCORE_CTRL = 0xffff
+
+
+def read_dump(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, nb_rings, ring_size, event_size, tsc_hz = FILE_HDR.unpack_from(data, 0)
+    if magic != b'DQSTRACE' or version != 1:
+        sys.exit('%s: not a daqswitch trace' % path)
+    if event_size != EVENT.size:
+        sys.exit('%s: unexpected event size %d' % (path, event_size))
+
+    events = []
+    off = FILE_HDR.size
+    for _ in range(nb_rings):
+        lcore_id, _, head = RING_HDR.unpack_from(data, off)
+        off += RING_HDR.size
+        # the slot at head may have been in the middle of an overwrite
+        first = max(0, head - (ring_size - 1))
+        for seq in range(first, head):
+            slot = off + (seq % ring_size) * event_size
+            tsc, ev_type, port, queue, arg = EVENT.unpack_from(data, slot)
+            events.append((tsc, lcore_id, ev_type, port, queue, arg))
+        off += ring_size * event_size
+
+    events.sort()
+    return events, tsc_hz
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: %s FILE [--last N]' % sys.argv[0])
+
+    events, tsc_hz = read_dump(sys.argv[1])
+    if '--last' in sys.argv:
+        events = events[-int(sys.argv[sys.argv.index('--last') + 1]):]
+    if not events:
+        return
+
+    t0 = events[0][0]
+    print('%14s %6s %-14s %4s %5s %10s' % ('time [us]', 'lcore', 'event', 'port', 'queue', 'arg'))
+    for tsc, lcore_id, ev_type, port, queue, arg in events:
+        name = EVENTS[ev_type] if ev_type < len(EVENTS) else '?'
+        extra = ''
+        if name == 'stall_end':
+            extra = ' (%.1f us)' % (arg * 1e6 / tsc_hz)
+        print('%14.3f %6s %-14s %4d %5d %10d%s' % (
+            (tsc - t0) * 1e6 / tsc_hz,
+            'ctrl' if lcore_id == LCORE_CTRL else lcore_id,
+            name, port, queue, arg, extra))
+
+
+if __name__ == '__main__':
+    main()
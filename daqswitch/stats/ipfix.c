@@ -0,0 +1,333 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <rte_alarm.h>
+#include <rte_cycles.h>
+#include <rte_byteorder.h>
+
+#include "../common/common.h"
+#include "../dp/include/dp.h"
+#include "ipfix.h"
+
+#define IPFIX_VERSION                                                                    10
+#define IPFIX_SET_ID_TEMPLATE                                                             2
+#define IPFIX_TEMPLATE_ID                                                               256
+#define IPFIX_OBSERVATION_DOMAIN                                                          1
+/* keeps a message within a single standard ethernet frame */
+#define IPFIX_MSG_MAX                                                                  1400
+#define IPFIX_RECORDS_MAX                                                              4096
+
+#define IPFIX_MSG_HDR_SIZE                                                               16
+#define IPFIX_SET_HDR_SIZE                                                                4
+#define IPFIX_ENTERPRISE_BIT                                                         0x8000
+
+/* information elements of a record, in order
+ * a data flow of the switch aggregates all tcp connections towards
+ * a single destination, so the record key is the egress port, the voq
+ * and the destination address, not a 5-tuple */
+static const struct {
+    uint16_t id;
+    uint16_t len;
+    bool enterprise;
+} ipfix_fields[] = {
+    {  14, 4, false }, /* egressInterface */
+    {  12, 4, false }, /* destinationIPv4Address */
+    {  86, 8, false }, /* packetTotalCount */
+    {  85, 8, false }, /* octetTotalCount */
+    { 152, 8, false }, /* flowStartMilliseconds */
+    { 153, 8, false }, /* flowEndMilliseconds */
+    {   1, 4, true  }, /* dcm sink id */
+    {   2, 1, true  }, /* voq, 0xff for the default path */
+    {   3, 1, true  }, /* request flow */
+    {   4, 4, true  }, /* peak voq depth [packets] */
+    {   5, 8, true  }, /* back-pressure stall time [us] */
+    {   6, 8, true  }, /* packets marked with ecn ce */
+};
+
+#define IPFIX_NB_FIELDS           (sizeof(ipfix_fields) / sizeof(ipfix_fields[0]))
+#define IPFIX_RECORD_SIZE                                                                66
+
+static struct {
+    bool enabled;
+    unsigned interval;
+
+    /* collector or file */
+    int sock;
+    struct sockaddr_in collector;
+    FILE *file;
+
+    /* data records sent so far */
+    uint32_t seq;
+
+    /* wall clock at a tsc, to convert tsc into ms since the epoch */
+    uint64_t base_ms;
+    uint64_t base_tsc;
+    uint64_t tsc_hz;
+
+    struct dp_flow_record records[IPFIX_RECORDS_MAX];
+    uint8_t msg[IPFIX_MSG_MAX];
+} ipfix = {
+    .interval = IPFIX_INTERVAL_DEFAULT,
+    .sock = -1,
+};
+
+static inline uint8_t *
+put8(uint8_t *p, uint8_t v)
+{
+    *p = v;
+    return p + 1;
+}
+
+static inline uint8_t *
+put16(uint8_t *p, uint16_t v)
+{
+    v = rte_cpu_to_be_16(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static inline uint8_t *
+put32(uint8_t *p, uint32_t v)
+{
+    v = rte_cpu_to_be_32(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static inline uint8_t *
+put64(uint8_t *p, uint64_t v)
+{
+    v = rte_cpu_to_be_64(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static uint64_t
+tsc_to_ms(uint64_t tsc)
+{
+    if (tsc == 0) {
+        return 0;
+    }
+
+    return ipfix.base_ms + (tsc - ipfix.base_tsc) * 1000 / ipfix.tsc_hz;
+}
+
+/* template set, sent with every message, so a collector
+ * starting late or losing a datagram catches up */
+static uint8_t *
+put_template_set(uint8_t *p)
+{
+    uint8_t *set = p;
+    unsigned i;
+
+    p += IPFIX_SET_HDR_SIZE;
+    p = put16(p, IPFIX_TEMPLATE_ID);
+    p = put16(p, IPFIX_NB_FIELDS);
+    for (i = 0; i < IPFIX_NB_FIELDS; i++) {
+        if (ipfix_fields[i].enterprise) {
+            p = put16(p, ipfix_fields[i].id | IPFIX_ENTERPRISE_BIT);
+            p = put16(p, ipfix_fields[i].len);
+            p = put32(p, IPFIX_PEN);
+        } else {
+            p = put16(p, ipfix_fields[i].id);
+            p = put16(p, ipfix_fields[i].len);
+        }
+    }
+
+    put16(set, IPFIX_SET_ID_TEMPLATE);
+    put16(set + 2, p - set);
+
+    return p;
+}
+
+static uint8_t *
+put_record(uint8_t *p, const struct dp_flow_record *r)
+{
+    p = put32(p, r->port_id);
+    p = put32(p, rte_be_to_cpu_32(r->dest_ip));
+    p = put64(p, r->packets);
+    p = put64(p, r->bytes);
+    p = put64(p, tsc_to_ms(r->start_tsc));
+    p = put64(p, tsc_to_ms(r->end_tsc));
+    p = put32(p, r->sink_id);
+    p = put8(p, r->flow_id);
+    p = put8(p, r->req_flow);
+    p = put32(p, r->max_depth);
+    /* cycles per us first, the stall cycles of a long flow times 10^6 overflow */
+    p = put64(p, r->stall_cycles / (ipfix.tsc_hz / US_PER_S));
+    p = put64(p, r->ecn_marked);
+
+    return p;
+}
+
+/* to the file and the collector, whichever are configured */
+static int
+send_msg(size_t len)
+{
+    ssize_t ret;
+    int err = 0;
+
+    if (ipfix.file) {
+        if (fwrite(ipfix.msg, len, 1, ipfix.file) != 1) {
+            err = -1;
+        }
+        fflush(ipfix.file);
+    }
+
+    if (ipfix.sock >= 0) {
+        ret = sendto(ipfix.sock, ipfix.msg, len, 0,
+                     (struct sockaddr *) &ipfix.collector, sizeof(ipfix.collector));
+        if (ret != (ssize_t) len) {
+            err = -1;
+        }
+    }
+
+    return err;
+}
+
+/* exports all records, as many messages as needed */
+static void
+export_records(void)
+{
+    unsigned nb_records, i, n;
+    uint8_t *p, *set;
+    uint32_t export_time = time(NULL);
+
+    nb_records = dp_flow_records_get(ipfix.records, IPFIX_RECORDS_MAX);
+
+    for (i = 0; i < nb_records; ) {
+        p = put_template_set(ipfix.msg + IPFIX_MSG_HDR_SIZE);
+
+        set = p;
+        p += IPFIX_SET_HDR_SIZE;
+        for (n = 0; i < nb_records &&
+                    p + IPFIX_RECORD_SIZE <= ipfix.msg + IPFIX_MSG_MAX; i++, n++) {
+            p = put_record(p, &ipfix.records[i]);
+        }
+        put16(set, IPFIX_TEMPLATE_ID);
+        put16(set + 2, p - set);
+
+        put16(ipfix.msg, IPFIX_VERSION);
+        put16(ipfix.msg + 2, p - ipfix.msg);
+        put32(ipfix.msg + 4, export_time);
+        put32(ipfix.msg + 8, ipfix.seq);
+        put32(ipfix.msg + 12, IPFIX_OBSERVATION_DOMAIN);
+
+        if (send_msg(p - ipfix.msg) < 0) {
+            DAQSWITCH_LOG_ERR("ipfix export failed");
+            return;
+        }
+
+        ipfix.seq += n;
+    }
+}
+
+/* runs in the eal interrupt thread, away from the datapath lcores */
+static void
+export_alarm(__attribute__((unused)) void *arg)
+{
+    export_records();
+
+    if (rte_eal_alarm_set(ipfix.interval * US_PER_S, export_alarm, NULL) < 0) {
+        DAQSWITCH_LOG_ERR("failed to re-arm ipfix export, export stopped");
+    }
+}
+
+/* addr is ipv4:port */
+int
+ipfix_set_collector(const char *addr)
+{
+    char ip[INET_ADDRSTRLEN];
+    const char *sep = strchr(addr, ':');
+    int port;
+
+    if (sep == NULL || (size_t) (sep - addr) >= sizeof(ip)) {
+        return -1;
+    }
+
+    memcpy(ip, addr, sep - addr);
+    ip[sep - addr] = '\0';
+    port = atoi(sep + 1);
+    if (port <= 0 || port > 65535) {
+        return -1;
+    }
+
+    memset(&ipfix.collector, 0, sizeof(ipfix.collector));
+    ipfix.collector.sin_family = AF_INET;
+    ipfix.collector.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &ipfix.collector.sin_addr) != 1) {
+        return -1;
+    }
+
+    ipfix.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ipfix.sock < 0) {
+        return -1;
+    }
+
+    ipfix.enabled = true;
+    return 0;
+}
+
+int
+ipfix_set_file(const char *path)
+{
+    ipfix.file = fopen(path, "wb");
+    if (ipfix.file == NULL) {
+        return -1;
+    }
+
+    ipfix.enabled = true;
+    return 0;
+}
+
+int
+ipfix_set_interval(const char *interval)
+{
+    int s = atoi(interval);
+
+    if (s <= 0) {
+        return -1;
+    }
+
+    ipfix.interval = s;
+    return 0;
+}
+
+/* starts the periodic export, nothing to do if not configured */
+int
+ipfix_start(void)
+{
+    struct timeval tv;
+
+    if (!ipfix.enabled) {
+        return 0;
+    }
+
+    gettimeofday(&tv, NULL);
+    ipfix.base_tsc = rte_rdtsc();
+    ipfix.base_ms = (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    ipfix.tsc_hz = rte_get_tsc_hz();
+
+    DAQSWITCH_LOG_INFO("exporting flow records every %u s", ipfix.interval);
+
+    return rte_eal_alarm_set(ipfix.interval * US_PER_S, export_alarm, NULL);
+}
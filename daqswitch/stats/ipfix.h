@@ -0,0 +1,29 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef IPFIX_H
+#define IPFIX_H
+
+/* ipfix (rfc 7011) export of the flow records of the datapath */
+
+/* enterprise number of the daqswitch specific information elements,
+ * defaults to the one reserved for documentation (rfc 5612) */
+#ifndef IPFIX_PEN
+    #define IPFIX_PEN                                                                 32473
+#endif
+#define IPFIX_INTERVAL_DEFAULT                                                         10 /* s */
+
+int ipfix_set_collector(const char *addr);
+int ipfix_set_file(const char *path);
+int ipfix_set_interval(const char *interval);
+int ipfix_start(void);
+
+#endif /* IPFIX_H */
@@ -30,7 +30,7 @@ void stats_reset(void)
     uint8_t port_id;
 
     DAQSWITCH_PORT_FOREACH(port_id) {
-        rte_eth_stats_reset(port_id);
+        daqswitch_port_stats_reset(port_id);
 
         for (i = 0; i < DAQSWITCH_MAX_QUEUES_PER_PORT; i++) {
             memset(&daqswitch_tx_queue_stats[port_id][i], 0, sizeof(struct daqswitch_stats));
@@ -65,7 +65,7 @@ void stats_print(unsigned interval)
     total_rx_bw = 0.0;
 
     DAQSWITCH_PORT_FOREACH(port_id) {
-        rte_eth_stats_get(port_id, &stats_before[port_id]);
+        daqswitch_port_stats_get(port_id, &stats_before[port_id]);
     }
     DAQSWITCH_PORT_FOREACH(port_id) {
         for (i = 0; i < DAQSWITCH_MAX_QUEUES_PER_PORT; i++) {
@@ -77,7 +77,7 @@ void stats_print(unsigned interval)
     usleep(interval * USECS_IN_MSEC);
 
     DAQSWITCH_PORT_FOREACH(port_id) {
-       rte_eth_stats_get(port_id, &stats_after[port_id]);
+       daqswitch_port_stats_get(port_id, &stats_after[port_id]);
     }
     DAQSWITCH_PORT_FOREACH(port_id) {
         for (i = 0; i < DAQSWITCH_MAX_QUEUES_PER_PORT; i++) {
@@ -0,0 +1,124 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_cycles.h>
+
+#include "stats_hist.h"
+
+/* lowest value falling into bucket b */
+static uint64_t
+bucket_lower(uint32_t b)
+{
+    uint32_t shift;
+
+    if (b < STATS_HIST_SUB_BUCKETS) {
+        return b;
+    }
+
+    shift = (b >> STATS_HIST_SUB_BITS) - 1;
+    return (uint64_t) (STATS_HIST_SUB_BUCKETS + (b & (STATS_HIST_SUB_BUCKETS - 1))) << shift;
+}
+
+/* highest value falling into bucket b */
+static uint64_t
+bucket_upper(uint32_t b)
+{
+    if (b == STATS_HIST_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+
+    return bucket_lower(b + 1) - 1;
+}
+
+void
+stats_hist_reset(struct stats_hist *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void
+stats_hist_merge(struct stats_hist *dst, const struct stats_hist *src)
+{
+    uint32_t b;
+
+    for (b = 0; b < STATS_HIST_BUCKETS; b++) {
+        dst->count[b] += src->count[b];
+    }
+
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/* value below which p percent of the samples fall, the upper bound of the
+ * bucket is returned, so it is never underestimated, but it is capped by
+ * the maximum seen */
+uint64_t
+stats_hist_percentile(const struct stats_hist *h, double p)
+{
+    uint64_t rank, seen = 0;
+    uint32_t b;
+
+    if (h->total == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t) (p / 100.0 * h->total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (b = 0; b < STATS_HIST_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen >= rank) {
+            return RTE_MIN(bucket_upper(b), h->max);
+        }
+    }
+
+    return h->max;
+}
+
+#define CYCLES_TO_US(c, hz)                    ((double) (c) * 1.0e6 / (double) (hz))
+
+void
+stats_hist_print_header(void)
+{
+    printf("+------------------+--------------+------------+------------+------------+------------+------------+------------+\n");
+    printf("| Queue            | Samples      | Mean [us]  | p50 [us]   | p90 [us]   | p99 [us]   | p99.9 [us] | Max [us]   |\n");
+    printf("+------------------+--------------+------------+------------+------------+------------+------------+------------+\n");
+}
+
+void
+stats_hist_print(const char *label, const struct stats_hist *h)
+{
+    uint64_t hz = rte_get_tsc_hz();
+
+    printf("| %-16s | %12" PRIu64 " | %10.2f | %10.2f | %10.2f | %10.2f | %10.2f | %10.2f |\n",
+           label, h->total,
+           h->total ? CYCLES_TO_US(h->sum / h->total, hz) : 0.0,
+           CYCLES_TO_US(stats_hist_percentile(h, 50.0), hz),
+           CYCLES_TO_US(stats_hist_percentile(h, 90.0), hz),
+           CYCLES_TO_US(stats_hist_percentile(h, 99.0), hz),
+           CYCLES_TO_US(stats_hist_percentile(h, 99.9), hz),
+           CYCLES_TO_US(h->max, hz));
+}
+
+void
+stats_hist_print_footer(void)
+{
+    printf("+------------------+--------------+------------+------------+------------+------------+------------+------------+\n");
+}
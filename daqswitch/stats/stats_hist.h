@@ -0,0 +1,76 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef STATS_HIST_H
+#define STATS_HIST_H
+
+#include <stdint.h>
+
+#include <rte_memory.h>
+
+/* log-linear histogram of tsc cycles
+ * values below 2^STATS_HIST_SUB_BITS have a bucket each, above that every
+ * power of two is split into 2^STATS_HIST_SUB_BITS linear sub-buckets, so a
+ * bucket is never wider than 1/2^STATS_HIST_SUB_BITS of its lower bound
+ * values from 2^STATS_HIST_MAX_BITS cycles on share the last bucket */
+#define STATS_HIST_SUB_BITS                                         3
+#define STATS_HIST_MAX_BITS                                        32
+#define STATS_HIST_SUB_BUCKETS                (1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_BUCKETS                                                        \
+    ((STATS_HIST_MAX_BITS - STATS_HIST_SUB_BITS + 1) * STATS_HIST_SUB_BUCKETS)
+
+/* a single writer is assumed, readers get a consistent enough view
+ * for statistics without any synchronization */
+struct stats_hist {
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t count[STATS_HIST_BUCKETS];
+} __rte_cache_aligned;
+
+static inline uint32_t
+stats_hist_bucket(uint64_t v)
+{
+    uint32_t msb, shift;
+
+    if (v < STATS_HIST_SUB_BUCKETS) {
+        return v;
+    }
+
+    msb = 63 - __builtin_clzll(v);
+    if (msb >= STATS_HIST_MAX_BITS) {
+        return STATS_HIST_BUCKETS - 1;
+    }
+
+    shift = msb - STATS_HIST_SUB_BITS;
+    return ((shift + 1) << STATS_HIST_SUB_BITS) +
+           ((v >> shift) & (STATS_HIST_SUB_BUCKETS - 1));
+}
+
+static inline void
+stats_hist_record(struct stats_hist *h, uint64_t v)
+{
+    h->count[stats_hist_bucket(v)]++;
+    h->total++;
+    h->sum += v;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+void stats_hist_reset(struct stats_hist *h);
+void stats_hist_merge(struct stats_hist *dst, const struct stats_hist *src);
+uint64_t stats_hist_percentile(const struct stats_hist *h, double p);
+void stats_hist_print_header(void);
+void stats_hist_print(const char *label, const struct stats_hist *h);
+void stats_hist_print_footer(void);
+
+#endif /* STATS_HIST_H */
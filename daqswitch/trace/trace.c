@@ -0,0 +1,371 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <rte_malloc.h>
+#include <rte_alarm.h>
+#include <rte_ethdev.h>
+
+#include "../common/common.h"
+#include "../daqswitch/daqswitch.h"
+#include "../daqswitch/daqswitch_port.h"
+#include "trace.h"
+
+#define TRACE_FILE_MAGIC                                                         "DQSTRACE"
+#define TRACE_FILE_VERSION                                                                1
+/* lcore id of the ring written by the eal interrupt thread */
+#define TRACE_LCORE_CTRL                                                             0xffff
+#define TRACE_PATH_MAX                                                                  256
+
+/* dump file layout: a header, then per ring a ring header followed by
+ * TRACE_RING_SIZE events in slot order */
+struct trace_file_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_rings;
+    uint32_t ring_size;
+    uint32_t event_size;
+    uint64_t tsc_hz;
+};
+
+struct trace_ring_hdr {
+    uint32_t lcore_id;
+    uint32_t pad;
+    uint64_t head;
+};
+
+static char trace_file[TRACE_PATH_MAX] = TRACE_FILE_DEFAULT;
+
+int
+trace_set_file(const char *path)
+{
+    if (strlen(path) >= sizeof(trace_file)) {
+        return -1;
+    }
+
+    strcpy(trace_file, path);
+    return 0;
+}
+
+#ifndef DAQSWITCH_TRACE_DISABLE
+struct trace_ring *trace_rings[RTE_MAX_LCORE];
+
+/* pause frames are consumed by the nic, only the counters tell */
+static struct trace_ring *trace_ctrl_ring;
+static uint64_t pause_xoff[DAQSWITCH_MAX_PORTS];
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = write(fd, p, len);
+        if (ret <= 0) {
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+static int
+write_ring(int fd, const struct trace_ring *r)
+{
+    struct trace_ring_hdr hdr;
+
+    hdr.lcore_id = r->lcore_id;
+    hdr.pad = 0;
+    hdr.head = r->head;
+
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0) {
+        return -1;
+    }
+
+    return write_all(fd, r->events, sizeof(r->events));
+}
+
+/* async-signal-safe, the rings keep being written while dumping */
+static int
+write_dump(const char *path)
+{
+    struct trace_file_hdr hdr;
+    unsigned lcore_id;
+    int fd, ret = 0;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_FILE_VERSION;
+    hdr.ring_size = TRACE_RING_SIZE;
+    hdr.event_size = sizeof(struct trace_event);
+    hdr.tsc_hz = rte_get_tsc_hz();
+    for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        hdr.nb_rings += trace_rings[lcore_id] != NULL;
+    }
+    hdr.nb_rings += trace_ctrl_ring != NULL;
+
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0) {
+        ret = -1;
+    }
+
+    for (lcore_id = 0; lcore_id < RTE_MAX_LCORE && ret == 0; lcore_id++) {
+        if (trace_rings[lcore_id] != NULL) {
+            ret = write_ring(fd, trace_rings[lcore_id]);
+        }
+    }
+    if (trace_ctrl_ring != NULL && ret == 0) {
+        ret = write_ring(fd, trace_ctrl_ring);
+    }
+
+    close(fd);
+
+    return ret;
+}
+
+/* dumps the rings, then lets the default action terminate the process */
+static void
+crash_handler(int sig)
+{
+    static const char msg[] = "daqswitch: crashed, trace dumped\n";
+
+    if (write_dump(trace_file) == 0) {
+        write_all(STDERR_FILENO, msg, sizeof(msg) - 1);
+    }
+
+    raise(sig);
+}
+
+/* runs in the eal interrupt thread, a port per run, as a read
+ * of the device stats goes through the whole register block */
+static void
+pause_poll(__attribute__((unused)) void *arg)
+{
+    static uint8_t port_id;
+    struct rte_eth_stats stats;
+
+    if (daqswitch_get_nb_ports() == 0) {
+        goto rearm;
+    }
+    if (port_id >= daqswitch_get_nb_ports()) {
+        port_id = 0;
+    }
+
+    daqswitch_port_stats_get(port_id, &stats);
+    if (stats.rx_pause_xoff > pause_xoff[port_id]) {
+        trace_ring_write(trace_ctrl_ring, TRACE_EV_PAUSE_RX, port_id, 0,
+                         stats.rx_pause_xoff - pause_xoff[port_id]);
+    }
+    /* counters may have been reset in between */
+    pause_xoff[port_id] = stats.rx_pause_xoff;
+    port_id++;
+
+rearm:
+    rte_eal_alarm_set(TRACE_PAUSE_POLL_INTERVAL, pause_poll, NULL);
+}
+
+static struct trace_ring *
+ring_create(uint32_t lcore_id, int socket_id)
+{
+    struct trace_ring *r;
+    char name[32];
+
+    snprintf(name, sizeof(name), "trace_ring_%u", lcore_id);
+    r = rte_zmalloc_socket(name, sizeof(struct trace_ring), CACHE_LINE_SIZE, socket_id);
+    if (r != NULL) {
+        r->lcore_id = lcore_id;
+    }
+
+    return r;
+}
+
+/* allocates the rings and installs the crash handler */
+int
+trace_init(void)
+{
+    static const int signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    struct sigaction sa;
+    unsigned lcore_id, i;
+
+    DAQSWITCH_LOG_ENTRY();
+
+    RTE_BUILD_BUG_ON((TRACE_RING_SIZE & TRACE_RING_MASK) != 0);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        trace_rings[lcore_id] = ring_create(lcore_id, rte_lcore_to_socket_id(lcore_id));
+        if (trace_rings[lcore_id] == NULL) {
+            DAQSWITCH_LOG_ERR("Cannot allocate trace ring of lcore %u", lcore_id);
+            return DAQSWITCH_ERR;
+        }
+    }
+
+    trace_ctrl_ring = ring_create(TRACE_LCORE_CTRL, rte_socket_id());
+    if (trace_ctrl_ring == NULL) {
+        DAQSWITCH_LOG_ERR("Cannot allocate trace ring");
+        return DAQSWITCH_ERR;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < RTE_DIM(signals); i++) {
+        sigaction(signals[i], &sa, NULL);
+    }
+
+    if (rte_eal_alarm_set(TRACE_PAUSE_POLL_INTERVAL, pause_poll, NULL) < 0) {
+        DAQSWITCH_LOG_ERR("Cannot start pause frame polling");
+        return DAQSWITCH_ERR;
+    }
+
+    DAQSWITCH_LOG_EXIT();
+
+    return DAQSWITCH_SUCCESS;
+}
+
+int
+trace_dump(void)
+{
+    if (write_dump(trace_file) < 0) {
+        printf("Cannot write trace to %s\n", trace_file);
+        return -1;
+    }
+
+    printf("Trace written to %s\n", trace_file);
+    return 0;
+}
+
+static const char *trace_event_names[TRACE_EV_MAX] = {
+    [TRACE_EV_NONE]          = "none",
+    [TRACE_EV_FLOW_DETECTED] = "flow_detected",
+    [TRACE_EV_FILTER_ADDED]  = "filter_added",
+    [TRACE_EV_VOQ_ACTIVATED] = "voq_activated",
+    [TRACE_EV_VOQ_FULL]      = "voq_full",
+    [TRACE_EV_TXQ_FULL]      = "txq_full",
+    [TRACE_EV_STALL_BEGIN]   = "stall_begin",
+    [TRACE_EV_STALL_END]     = "stall_end",
+    [TRACE_EV_PAUSE_RX]      = "pause_rx",
+    [TRACE_EV_ADM_HOLD]      = "adm_hold",
+};
+
+/* prints the n most recent events of all rings, oldest first */
+void
+trace_show(unsigned n)
+{
+    struct trace_ring *rings[RTE_MAX_LCORE + 1];
+    uint64_t cursor[RTE_MAX_LCORE + 1];
+    uint64_t oldest[RTE_MAX_LCORE + 1];
+    struct trace_event ev, last;
+    unsigned nb_rings = 0, i, pick;
+    struct trace_event *sel;
+    uint32_t *sel_lcore;
+    uint64_t now;
+    char lcore[8];
+
+    for (i = 0; i < RTE_MAX_LCORE; i++) {
+        if (trace_rings[i] != NULL) {
+            rings[nb_rings++] = trace_rings[i];
+        }
+    }
+    rings[nb_rings++] = trace_ctrl_ring;
+
+    /* the slot at head may be in the middle of an overwrite */
+    for (i = 0; i < nb_rings; i++) {
+        cursor[i] = rings[i]->head;
+        oldest[i] = cursor[i] > TRACE_RING_SIZE - 1 ? cursor[i] - (TRACE_RING_SIZE - 1) : 0;
+    }
+
+    sel = malloc(n * sizeof(*sel));
+    sel_lcore = malloc(n * sizeof(*sel_lcore));
+    if (sel == NULL || sel_lcore == NULL) {
+        free(sel);
+        free(sel_lcore);
+        return;
+    }
+
+    /* merge from the newest backwards */
+    for (pick = 0; pick < n; pick++) {
+        unsigned best = nb_rings;
+
+        for (i = 0; i < nb_rings; i++) {
+            if (cursor[i] == oldest[i]) {
+                continue;
+            }
+            ev = rings[i]->events[(cursor[i] - 1) & TRACE_RING_MASK];
+            if (best == nb_rings || ev.tsc > last.tsc) {
+                best = i;
+                last = ev;
+            }
+        }
+        if (best == nb_rings) {
+            break;
+        }
+        cursor[best]--;
+        sel[pick] = last;
+        sel_lcore[pick] = rings[best]->lcore_id;
+    }
+
+    now = rte_rdtsc();
+
+    printf("+---------------+--------+----------------+------+-------+------------+\n");
+    printf("| Age [us]      | Lcore  | Event          | Port | Queue | Arg        |\n");
+    printf("+---------------+--------+----------------+------+-------+------------+\n");
+    while (pick-- > 0) {
+        ev = sel[pick];
+        if (sel_lcore[pick] == TRACE_LCORE_CTRL) {
+            snprintf(lcore, sizeof(lcore), "ctrl");
+        } else {
+            snprintf(lcore, sizeof(lcore), "%u", sel_lcore[pick]);
+        }
+        printf("| %13.1f | %6s | %-14s | %4u | %5u | %10u |\n",
+               (double) (now - ev.tsc) * 1.0e6 / rte_get_tsc_hz(),
+               lcore,
+               ev.type < TRACE_EV_MAX ? trace_event_names[ev.type] : "?",
+               ev.port, ev.queue, ev.arg);
+    }
+    printf("+---------------+--------+----------------+------+-------+------------+\n");
+
+    free(sel);
+    free(sel_lcore);
+}
+#else
+int
+trace_init(void)
+{
+    return DAQSWITCH_SUCCESS;
+}
+
+int
+trace_dump(void)
+{
+    printf("Tracing disabled\n");
+    return 0;
+}
+
+void
+trace_show(__attribute__((unused)) unsigned n)
+{
+    printf("Tracing disabled\n");
+}
+#endif
@@ -0,0 +1,111 @@
+/* © Copyright 2016 CERN
+ *
+ * This software is distributed under the terms of the GNU General Public 
+ * Licence version 3 (GPL Version 3), copied verbatim in the file "LICENSE".
+ *
+ * In applying this licence, CERN does not waive the privileges and immunities
+ * granted to it by virtue of its status as an Intergovernmental Organization 
+ * or submit itself to any jurisdiction.
+ *
+ * Author: Grzegorz Jereczek <grzegorz.jereczek@cern.ch>
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_branch_prediction.h>
+
+/* flight recorder
+ *
+ * every lcore writes compact binary events into its own ring in hugepage
+ * memory, the oldest events are overwritten, so the ring always holds the
+ * history right before a problem
+ * the rings are dumped to a file with `trace dump` or when the process
+ * crashes, scripts/trace_decode.py turns a dump into text */
+
+/* events per lcore, must be a power of 2 */
+#ifndef TRACE_RING_SIZE
+    #define TRACE_RING_SIZE                                                           16384
+#endif
+#define TRACE_RING_MASK                                                 (TRACE_RING_SIZE - 1)
+/* events printed by `trace show` without a count */
+#ifndef TRACE_SHOW_COUNT
+    #define TRACE_SHOW_COUNT                                                             64
+#endif
+/* interval of the pause frame counter polling, one port at a time,
+ * so each port is polled every nb_ports intervals */
+#ifndef TRACE_PAUSE_POLL_INTERVAL
+    #define TRACE_PAUSE_POLL_INTERVAL                                                  1000 /* us */
+#endif
+#define TRACE_FILE_DEFAULT                                                "daqswitch.trace"
+
+/* keep in sync with scripts/trace_decode.py */
+enum trace_event_type {
+    TRACE_EV_NONE = 0,
+    TRACE_EV_FLOW_DETECTED,     /* port: dcm port, queue: ros port, arg: event id */
+    TRACE_EV_FILTER_ADDED,      /* port, queue: rx queue, arg: fdir id */
+    TRACE_EV_VOQ_ACTIVATED,     /* port, queue: voq, arg: sink id */
+    TRACE_EV_VOQ_FULL,          /* port, queue: voq, arg: packets dropped */
+    TRACE_EV_TXQ_FULL,          /* port, queue: tx queue, arg: packets left */
+    TRACE_EV_STALL_BEGIN,       /* port, queue: voq, arg: input port */
+    TRACE_EV_STALL_END,         /* port, queue: voq, arg: stall cycles */
+    TRACE_EV_PAUSE_RX,          /* port, arg: xoff frames since the last poll */
+    TRACE_EV_ADM_HOLD,          /* port: ros port, queue: dcm port, arg: dcm ip */
+    TRACE_EV_MAX,
+};
+
+struct trace_event {
+    uint64_t tsc;
+    uint16_t type;
+    uint8_t port;
+    uint8_t queue;
+    uint32_t arg;
+};
+
+/* written by a single thread, the lcore owning it */
+struct trace_ring {
+    uint64_t head;
+    uint32_t lcore_id;
+    struct trace_event events[TRACE_RING_SIZE] __rte_cache_aligned;
+} __rte_cache_aligned;
+
+extern struct trace_ring *trace_rings[RTE_MAX_LCORE];
+
+static inline void
+trace_ring_write(struct trace_ring *r, uint16_t type, uint8_t port,
+                 uint8_t queue, uint32_t arg)
+{
+    struct trace_event *ev = &r->events[r->head & TRACE_RING_MASK];
+
+    ev->tsc = rte_rdtsc();
+    ev->type = type;
+    ev->port = port;
+    ev->queue = queue;
+    ev->arg = arg;
+
+    /* publish, readers take the events below head only */
+    rte_compiler_barrier();
+    r->head++;
+}
+
+#ifndef DAQSWITCH_TRACE_DISABLE
+#define TRACE(type, port, queue, arg)                                                  \
+    do {                                                                               \
+        struct trace_ring *_r = trace_rings[rte_lcore_id()];                           \
+        if (likely(_r != NULL)) {                                                      \
+            trace_ring_write(_r, TRACE_EV_##type, port, queue, arg);                   \
+        }                                                                              \
+    } while (0)
+#else
+#define TRACE(type, port, queue, arg) do { } while (0)
+#endif
+
+int trace_init(void);
+int trace_set_file(const char *path);
+int trace_dump(void);
+void trace_show(unsigned n);
+
+#endif /* TRACE_H */